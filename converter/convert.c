@@ -5,12 +5,25 @@
  * Converts a text file in bytecode-language into a binary file and uploads
  * this to an Arduino running ArduinOS using the "erase" and "store" commands.
  * 
- * Usage: convert <file> <serial port>
+ * Usage: convert [-z] [-b <rate>] <file> <serial port>
+ * -z: compress the file, when this makes it smaller
+ * -b: baud rate of the Arduino, set with its "baud" command (default 9600)
+ * 
+ * Or download a file from the Arduino with "retrieve <file> binary", checking its CRC:
+ * convert [-b <rate>] -download <file> <local file> <serial port>
+ * 
+ * Or bake files into the read-only volume in program memory:
+ * convert -rom <file> ... > ../src/rom_files.cpp
+ * 
+ * Or build a complete EEPROM image of 1024 (Uno) or 4096 (Mega) bytes from files, or all
+ * files in directories, to flash with avrdude -U eeprom:w:<image file>:r
+ * convert [-z] -image <eeprom size> <image file> <file or directory> ...
  * 
  * Compilation with gcc or clang on Windows, Linux or MacOS:
  * gcc -o convert convert.c
  */
 #define BUFSIZE 128
+#define BPS 9600
 #define PROGSIZE 255
 #define C_CHAR 1
 #define C_INT 2
@@ -19,16 +32,36 @@
 #define C_IF 128
 #define C_ELSE 129
 #define C_WHILE 131
+#define LZ_HEADER 2
+#define LZ_WINDOW 32
+#define LZ_MIN_LENGTH 2
+#define LZ_MAX_LENGTH (LZ_MIN_LENGTH + 7)
+#define RETRIEVE_CHUNK 32
+#define READ_TIMEOUT 2
+// layout of the filesystem on the EEPROM, see include/filesystem.h
+#define FORMAT_PTR 0
+#define NOF_PTR 1
+#define FST_PTR 2
+#define FS_FORMAT 0xA2
+#define FAT_RESERVE 4
+#define REGION_SIZE 128
+#define FILE_ENTRY_SIZE 19  // sizeof(File) on the Arduino: name, addr, size, crc and flags
+#define FILE_COMPRESSED 0x01
+#define END_RECORDS_SIZE 142 // sizeof(Config) + 4 * sizeof(Journal) + sizeof(Move) on the Arduino
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "instruction_array.h"
+#include "../include/common.h"
 
 #ifdef _WIN32
 #include <windows.h>
-#define BPS 9600
+typedef HANDLE Port;
 
 // Read characters from serial stream pointed to by h until timeout
 // Copy characters into buffer
@@ -43,6 +76,22 @@ int readLine(HANDLE h, char *buffer) {
     return (int)bytesRead;
 }
 
+// Read noOfBytes characters from serial stream pointed to by h into buffer
+// Return number of characters read, less when nothing arrives for READ_TIMEOUT seconds
+int readBytes(HANDLE h, unsigned char *buffer, int noOfBytes) {
+    DWORD bytesRead;
+    int n = 0;
+    time_t last = time(NULL);
+    while (n < noOfBytes && time(NULL) - last < READ_TIMEOUT) {
+        ReadFile(h, buffer + n, noOfBytes - n, &bytesRead, NULL);
+        if (bytesRead > 0) {
+            n += bytesRead;
+            last = time(NULL);
+        }
+    }
+    return n;
+}
+
 // Write a buffer to serial stream pointed to by h
 // Return number of characters written
 int writeBuffer(HANDLE h, char *buffer, int noOfBytes) {
@@ -61,7 +110,24 @@ int writeLine(HANDLE h, char *buffer) {
 #else // Linux and MacOS
 #include <fcntl.h>
 #include <termios.h>
-#define BPS B9600
+typedef int Port;
+
+// Convert a baud rate into a termios speed
+// Return 0 when the baud rate is not supported
+speed_t speedOf(long bps) {
+#ifdef __APPLE__
+    return bps; // speeds are plain numbers
+#else
+    switch (bps) {
+        case 9600: return B9600;
+        case 115200: return B115200;
+#ifdef B500000
+        case 500000: return B500000;
+#endif
+        default: return 0;
+    }
+#endif
+}
 
 // Read characters from serial stream pointed to by h until a newline character is read
 // Copy characters into buf
@@ -82,6 +148,21 @@ ssize_t readLine(int h, char *buf) {
     }
 }
 
+// Read noOfBytes characters from serial stream pointed to by h into buffer
+// Return number of characters read, less when nothing arrives for READ_TIMEOUT seconds
+ssize_t readBytes(int h, unsigned char *buffer, int noOfBytes) {
+    ssize_t bytesRead, n = 0;
+    time_t last = time(NULL);
+    while (n < noOfBytes && time(NULL) - last < READ_TIMEOUT) {
+        bytesRead = read(h, buffer + n, noOfBytes - n);
+        if (bytesRead > 0) {
+            n += bytesRead;
+            last = time(NULL);
+        }
+    }
+    return n;
+}
+
 // Write buffer to serial stream pointed to by h
 // Return number of characters written
 ssize_t writeBuffer(int h, unsigned char *buffer, int noOfBytes) {
@@ -141,23 +222,49 @@ char unescape(char c) {
     }
 }
 
-int main(int argc, char *argv[]) {
-    // check arguments
-    if (argc != 3) {
-        printf("Usage: %s <file> <serial port>\n", argv[0]);
-        return -1;
-    }
-    // open input file
-    FILE *file = fopen(argv[1], "r");
-    if (!file) {
-        printf("Cannot open file \"%s\"\n", argv[1]);
-        return -1;
+// Compress size bytes of in into out, in the format of the ArduinOS filesystem:
+// the original size and groups of a flag byte and 8 literals or back references
+// the file is marked as compressed in its FAT entry, not in the data
+// out must have room for size + size / 8 + LZ_HEADER + 1 bytes
+// Return the compressed size
+int compress(unsigned char *in, int size, unsigned char *out) {
+    int n = 0;
+    out[n++] = size >> 8;
+    out[n++] = size & 0xFF;
+    int flags = 0, items = 0;
+    for (int i = 0; i < size;) {
+        if (items == 0) { // start a new group
+            flags = n++;
+            out[flags] = 0;
+        }
+        // find the longest match within the window
+        int length = 0, distance = 0;
+        for (int d = 1; d <= LZ_WINDOW && d <= i; d++) {
+            int l = 0;
+            while (l < LZ_MAX_LENGTH && i + l < size && in[i + l] == in[i + l - d]) {
+                l++;
+            }
+            if (l > length) {
+                length = l;
+                distance = d;
+            }
+        }
+        if (length >= LZ_MIN_LENGTH) { // back reference
+            out[flags] |= 1 << items;
+            out[n++] = ((length - LZ_MIN_LENGTH) << 5) | (distance - 1);
+            i += length;
+        } else { // literal
+            out[n++] = in[i++];
+        }
+        items = (items + 1) % 8;
     }
+    return n;
+}
 
-    // process instructions
-    printf("Converting file \"%s\"\n", argv[1]);
+// Convert the bytecode-language in file into binary bytecode in prog
+// Return the size of the bytecode
+int convert(FILE *file, unsigned char *prog) {
     char buf[BUFSIZE];
-    unsigned char prog[PROGSIZE];
     int pc = 0;
     while (readToken(file, buf) != EOF) {
         int command = 0;
@@ -233,18 +340,335 @@ int main(int argc, char *argv[]) {
             }
         }
     }
+    return pc;
+}
+
+// Print the binary bytecode of files as a C source file, that bakes them into the read-only
+// volume of ArduinOS in program memory
+// Return 0 on success
+int printRom(int noOfFiles, char *names[]) {
+    unsigned char prog[PROGSIZE];
+    int addr = 0;
+    printf("// Generated by: convert -rom");
+    for (int f = 0; f < noOfFiles; f++) {
+        printf(" %s", names[f]);
+    }
+    printf("\n\n#include <Arduino.h>\n#include \"filesystem.h\"\n\n");
+    printf("const uint8_t rom_data[] PROGMEM = {");
+    int sizes[noOfFiles];
+    for (int f = 0; f < noOfFiles; f++) {
+        FILE *file = fopen(names[f], "r");
+        if (!file) {
+            fprintf(stderr, "Cannot open file \"%s\"\n", names[f]);
+            return -1;
+        }
+        sizes[f] = convert(file, prog);
+        fclose(file);
+        printf("\n    // %s", names[f]);
+        for (int i = 0; i < sizes[f]; i++) {
+            printf("%s0x%02x,", i % 12 ? " " : "\n    ", prog[i]);
+        }
+    }
+    printf("\n};\n\nconst File rom_files[] PROGMEM = {\n");
+    for (int f = 0; f < noOfFiles; f++) {
+        // the file name without the directory
+        char *name = strrchr(names[f], '/') ? strrchr(names[f], '/') + 1 : names[f];
+        if (strlen(name) >= FILENAME_SIZE) {
+            fprintf(stderr, "File name \"%s\" is too long\n", name);
+            return -1;
+        }
+        printf("    {\"%s\", ROM_DATA_PTR + %d, %d},\n", name, addr, sizes[f]);
+        addr += sizes[f];
+    }
+    printf("};\n\nconst uint8_t no_of_rom_files = %d;\n", noOfFiles);
+    return 0;
+}
+
+// Return the CRC-16 (CCITT) of a buffer, like ArduinOS calculates it
+unsigned short crc16(unsigned char *buffer, int size) {
+    unsigned short crc = 0xFFFF;
+    for (int i = 0; i < size; i++) {
+        crc ^= buffer[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Download a file with "retrieve <file> binary" and save it as name
+// Every frame, and the whole file, is checked with its CRC
+// Return 0 on success
+int download(Port h, char *remote, char *name) {
+    char buf[BUFSIZE];
+    unsigned char frame[RETRIEVE_CHUNK + 2];
+    printf("Receiving file \"%s\"\n", remote);
+    snprintf(buf, BUFSIZE, "retrieve %s binary", remote);
+    writeLine(h, buf);
+
+    // read the answer one character at a time, the frames follow directly
+    int n = 0;
+    while (n < BUFSIZE - 1 && readBytes(h, (unsigned char *)buf + n, 1) == 1 && buf[n] != '\n') {
+        n++;
+    }
+    buf[n] = '\0';
+    if (strncmp(buf, "Binary file", 11)) {
+        puts(buf);
+        return -1;
+    }
+    int size = atoi(strrchr(buf, ':') + 1);
+    unsigned char *data = malloc(size);
+
+    int pos = 0;
+    unsigned char length;
+    unsigned short crc;
+    do {
+        if (readBytes(h, &length, 1) != 1 || length > RETRIEVE_CHUNK || pos + length > size
+            || readBytes(h, frame, length + 2) != length + 2) {
+            printf("Transfer interrupted after %d bytes\n", pos);
+            free(data);
+            return -1;
+        }
+        crc = (frame[length] << 8) | frame[length + 1];
+        if (length > 0 && crc != crc16(frame, length)) {
+            printf("CRC error in the frame at byte %d\n", pos);
+            free(data);
+            return -1;
+        }
+        memcpy(data + pos, frame, length);
+        pos += length;
+    } while (length > 0);
+    if (pos != size || crc != crc16(data, size)) {
+        printf("CRC error in the file\n");
+        free(data);
+        return -1;
+    }
+
+    FILE *file = fopen(name, "wb");
+    if (!file) {
+        printf("Cannot open file \"%s\"\n", name);
+        free(data);
+        return -1;
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+    free(data);
+    printf("Received %d bytes, saved as \"%s\"\n", size, name);
+    return 0;
+}
+
+// Compare two file names for qsort
+int compareNames(const void *a, const void *b) {
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+// Add a file, or all files in a directory in alphabetical order, to the list of paths
+// Return the new number of paths, or -1 when there are too many
+int addPaths(char *path, char *paths[], int noOfPaths) {
+    struct stat info;
+    DIR *dir = opendir(path);
+    if (!dir) {
+        if (noOfPaths == MEGA_AMOUNT_OF_FILES) return -1;
+        paths[noOfPaths++] = strdup(path);
+        return noOfPaths;
+    }
+    int first = noOfPaths;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') continue;
+        char *file = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(file, "%s/%s", path, entry->d_name);
+        if (stat(file, &info) || !S_ISREG(info.st_mode)) {
+            free(file);
+            continue;
+        }
+        if (noOfPaths == MEGA_AMOUNT_OF_FILES) {
+            free(file);
+            closedir(dir);
+            return -1;
+        }
+        paths[noOfPaths++] = file;
+    }
+    closedir(dir);
+    qsort(paths + first, noOfPaths - first, sizeof(char *), compareNames);
+    return noOfPaths;
+}
+
+// Write a 16 bit value in the byte order of the Arduino
+void writeWord(unsigned char *image, int addr, int value) {
+    image[addr] = value & 0xFF;
+    image[addr + 1] = (value >> 8) & 0xFF;
+}
+
+// Build an EEPROM image with the bytecode of files, like ArduinOS stores them: the number of files,
+// the FAT with room for FAT_RESERVE more entries, and the data packed behind it without holes.
+// Everything else is erased, so the journal, defrag record, wear counters and config are empty
+// Return 0 on success
+int buildImage(int eepromSize, char *imageName, int noOfArgs, char *args[], int compressed) {
+    char *paths[MEGA_AMOUNT_OF_FILES];
+    int noOfFiles = 0;
+    for (int a = 0; a < noOfArgs; a++) {
+        noOfFiles = addPaths(args[a], paths, noOfFiles);
+        if (noOfFiles < 0) {
+            fprintf(stderr, "Too many files, at most %d files fit in the FAT\n", MEGA_AMOUNT_OF_FILES);
+            return -1;
+        }
+    }
+    // the FAT in RAM limits the amount of files, the Mega has the 4KB EEPROM
+    int maxFiles = eepromSize >= 4096 ? MEGA_AMOUNT_OF_FILES : UNO_AMOUNT_OF_FILES;
+    if (eepromSize <= 0 || noOfFiles > maxFiles) {
+        fprintf(stderr, "An EEPROM of %d bytes holds at most %d files\n", eepromSize, maxFiles);
+        return -1;
+    }
+
+    unsigned char *image = malloc(eepromSize);
+    memset(image, 0xFF, eepromSize);
+    image[FORMAT_PTR] = FS_FORMAT;
+    image[NOF_PTR] = noOfFiles;
+    int addr = FST_PTR + (noOfFiles + FAT_RESERVE) * FILE_ENTRY_SIZE;
+    int end = eepromSize - (eepromSize / REGION_SIZE) * 2 - END_RECORDS_SIZE;
+    for (int f = 0; f < noOfFiles; f++) {
+        FILE *file = fopen(paths[f], "r");
+        if (!file) {
+            fprintf(stderr, "Cannot open file \"%s\"\n", paths[f]);
+            return -1;
+        }
+        unsigned char prog[PROGSIZE];
+        int size = convert(file, prog);
+        fclose(file);
+        int flags = 0;
+        if (compressed) {
+            unsigned char packed[PROGSIZE + PROGSIZE / 8 + LZ_HEADER + 1];
+            int packedSize = compress(prog, size, packed);
+            if (packedSize < size) {
+                memcpy(prog, packed, packedSize);
+                size = packedSize;
+                flags = FILE_COMPRESSED;
+            }
+        }
+
+        // the file name without the directory
+        char *name = strrchr(paths[f], '/') ? strrchr(paths[f], '/') + 1 : paths[f];
+        if (strlen(name) >= FILENAME_SIZE) {
+            fprintf(stderr, "File name \"%s\" is too long\n", name);
+            return -1;
+        }
+        for (int g = 0; g < f; g++) {
+            if (!strncmp((char *)image + FST_PTR + g * FILE_ENTRY_SIZE, name, FILENAME_SIZE)) {
+                fprintf(stderr, "File name \"%s\" is used twice\n", name);
+                return -1;
+            }
+        }
+        if (size == 0 || addr + size > end) {
+            fprintf(stderr, "File \"%s\" is empty or doesn't fit on the EEPROM\n", name);
+            return -1;
+        }
+
+        int entry = FST_PTR + f * FILE_ENTRY_SIZE;
+        memset(image + entry, 0, FILENAME_SIZE);
+        strcpy((char *)image + entry, name);
+        writeWord(image, entry + FILENAME_SIZE, addr);
+        writeWord(image, entry + FILENAME_SIZE + 2, size);
+        writeWord(image, entry + FILENAME_SIZE + 4, crc16(prog, size));
+        image[entry + FILENAME_SIZE + 6] = flags;
+        memcpy(image + addr, prog, size);
+        printf("%s, %d bytes at address %d\n", name, size, addr);
+        addr += size;
+        free(paths[f]);
+    }
+
+    FILE *file = fopen(imageName, "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot open file \"%s\"\n", imageName);
+        return -1;
+    }
+    fwrite(image, 1, eepromSize, file);
     fclose(file);
-    printf("Converted size = %d bytes\n", pc);
+    free(image);
+    printf("Image of %d files, %d bytes free\n", noOfFiles, end - addr);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // check arguments
+    if (argc >= 3 && !strcmp(argv[1], "-rom")) {
+        return printRom(argc - 2, argv + 2);
+    }
+    int z = argc > 1 && !strcmp(argv[1], "-z");
+    if (argc >= z + 5 && !strcmp(argv[z + 1], "-image")) {
+        return buildImage(atoi(argv[z + 2]), argv[z + 3], argc - z - 4, argv + z + 4, z);
+    }
+    int compressed = 0;
+    char *remote = NULL;
+    long bps = BPS;
+    int a = 1;
+    for (; a < argc - 2; a++) {
+        if (!strcmp(argv[a], "-z")) {
+            compressed = 1;
+        } else if (!strcmp(argv[a], "-b") && a + 1 < argc - 2) {
+            bps = atol(argv[++a]);
+        } else if (!strcmp(argv[a], "-download") && a + 1 < argc - 2) {
+            remote = argv[++a];
+        } else {
+            break;
+        }
+    }
+    if (argc - a != 2) {
+        printf("Usage: %s [-z] [-b <rate>] <file> <serial port>\n", argv[0]);
+        printf("       %s [-b <rate>] -download <file> <local file> <serial port>\n", argv[0]);
+        printf("       %s -rom <file> ... > ../src/rom_files.cpp\n", argv[0]);
+        printf("       %s [-z] -image <eeprom size> <image file> <file or directory> ...\n", argv[0]);
+        return -1;
+    }
+#ifndef _WIN32
+    if (!speedOf(bps)) {
+        printf("Baud rate %ld is not supported on this system\n", bps);
+        return -1;
+    }
+#endif
+    char *name = argv[argc - 2];
+    char *port = argv[argc - 1];
+    char buf[BUFSIZE];
+    unsigned char prog[PROGSIZE];
+    int pc = 0;
+    if (remote == NULL) {
+        // open input file
+        FILE *file = fopen(name, "r");
+        if (!file) {
+            printf("Cannot open file \"%s\"\n", name);
+            return -1;
+        }
+
+        // process instructions
+        printf("Converting file \"%s\"\n", name);
+        pc = convert(file, prog);
+        fclose(file);
+        printf("Converted size = %d bytes\n", pc);
+
+        // compress the program
+        if (compressed) {
+            unsigned char packed[PROGSIZE + PROGSIZE / 8 + LZ_HEADER + 1];
+            int size = compress(prog, pc, packed);
+            if (size < pc) {
+                printf("Compressed size = %d bytes\n", size);
+                memcpy(prog, packed, size);
+                pc = size;
+            } else {
+                printf("Compression does not make the file smaller, sending it uncompressed\n");
+                compressed = 0;
+            }
+        }
+    }
 
     // check serial port
 #ifdef _WIN32
-    HANDLE h = CreateFile(argv[2], GENERIC_READ, 0, 0, OPEN_EXISTING, 0, 0);
+    HANDLE h = CreateFile(port, GENERIC_READ, 0, 0, OPEN_EXISTING, 0, 0);
     if (h == INVALID_HANDLE_VALUE) {
 #else // Linux and MacOS
-    int h = open(argv[2], O_RDONLY | O_NONBLOCK);
+    int h = open(port, O_RDONLY | O_NONBLOCK);
     if (h == -1) {
 #endif
-        printf("Cannot open port \"%s\".\n", argv[2]);
+        printf("Cannot open port \"%s\".\n", port);
         return -1;
     }
 #ifdef _WIN32
@@ -252,14 +676,14 @@ int main(int argc, char *argv[]) {
 #else // Linux and MacOS
     close(h);
 #endif
-    printf("Opening %s\n", argv[2]);
+    printf("Opening %s\n", port);
 
     // connect to Arduino
 #ifdef _WIN32
-    h = CreateFile(argv[2], GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+    h = CreateFile(port, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
     DCB dcbSerialParams = {0};
     dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
-    dcbSerialParams.BaudRate = BPS;
+    dcbSerialParams.BaudRate = bps;
     dcbSerialParams.ByteSize = 8;
     dcbSerialParams.StopBits = ONESTOPBIT;
     dcbSerialParams.Parity = NOPARITY;
@@ -272,23 +696,35 @@ int main(int argc, char *argv[]) {
     EscapeCommFunction(h, CLRDTR);
     sleep(1);
 #else // Linux and MacOS
-    h = open(argv[2], O_RDWR | O_NONBLOCK);
+    h = open(port, O_RDWR | O_NONBLOCK);
     struct termios settings;
     tcgetattr(h, &settings);
-    cfsetispeed(&settings, BPS);
-    cfsetospeed(&settings, BPS);
+    cfsetispeed(&settings, speedOf(bps));
+    cfsetospeed(&settings, speedOf(bps));
+    if (remote != NULL) {
+        cfmakeraw(&settings); // the frames are binary, no characters may be translated
+    }
     settings.c_cflag |= CLOCAL; // ignore modem status lines
     tcsetattr(h, TCSANOW, &settings);
 #endif
     readLine(h, buf); // wait for prompt
-    printf("Sending file \"%s\"\n", argv[1]);
-    snprintf(buf, BUFSIZE, "erase %s", argv[1]);
+    if (remote != NULL) {
+        int result = download(h, remote, name);
+#ifdef _WIN32
+        CloseHandle(h);
+#else // Linux and MacOS
+        close(h);
+#endif
+        return result;
+    }
+    printf("Sending file \"%s\"\n", name);
+    snprintf(buf, BUFSIZE, "erase %s", name);
     writeLine(h, buf);
 #ifdef _WIN32
     sleep(1);
 #endif
     readLine(h, buf); // read answer and discard
-    snprintf(buf, BUFSIZE, "store %s %d", argv[1], pc); 
+    snprintf(buf, BUFSIZE, "store %s %d%s", name, pc, compressed ? " z" : ""); 
     writeLine(h, buf);
     writeBuffer(h, prog, pc); // write data
 #ifdef _WIN32
@@ -63,6 +63,9 @@ instruction instrSet[] = {
     {"READCHAR", 57},
     {"READFLOAT", 58},
     {"READSTRING", 59},
+    {"WAITPIN", 60},
+    {"SEND", 61},
+    {"RECV", 62},
     {"IF", 128},
     {"ELSE", 129},
     {"ENDIF", 130},
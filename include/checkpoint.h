@@ -0,0 +1,64 @@
+/*
+ *
+ * ArduinOS - Checkpoint header file
+ * include/checkpoint.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <Arduino.h>
+#include "common.h"
+
+// first byte of a checkpoint file
+#define CHECKPOINT_MAGIC        0xC5
+// longest name of a program that can be saved, the checkpoint file adds ".ck"
+#define CHECKPOINT_NAME_SIZE    8
+// extra bytes in a new checkpoint file, so the next checkpoint can grow a bit without a new file
+#define CHECKPOINT_SLACK        8
+// processes that can be saved periodically
+#define MAX_AUTO_CHECKPOINTS    2
+
+// begin of a checkpoint file, followed by the stack and the variables of the process
+typedef struct {
+    uint8_t magic;
+    char program[FILENAME_SIZE];
+    int program_size;       // size and CRC of the program, a changed program can not be resumed
+    uint16_t program_crc;
+    int pc;                 // offset of the next instruction in the program
+    uint8_t typed;          // the program is translated to typed instructions
+    uint8_t state;
+    uint8_t sp;
+    uint8_t no_of_vars;
+} Checkpoint;
+
+typedef struct {
+    int proc_id;            // 0 when the slot is free
+    uint16_t interval;      // seconds between the checkpoints
+    unsigned long last;     // millis() at the last checkpoint
+} AutoCheckpoint;
+
+void runCheckpoints();
+
+void checkpoint(CommandArgs argv);
+void restore(CommandArgs argv);
+
+#endif
@@ -38,11 +38,18 @@
 #define ERASE               "erase"
 #define FILES               "files"
 #define FREESPACE           "freespace"
+#define WEAR                "wear"
+#define DEFRAG              "defrag"
 #define RUN                 "run"
 #define LIST                "list"
 #define SUSPEND             "suspend"
 #define RESUME              "resume"
 #define KILL                "kill"
+#define TRACE               "trace"
+#define BAUD                "baud"
+#define AUTOSTART           "autostart"
+#define CHECKPOINT          "checkpoint"
+#define RESTORE             "restore"
 
 // Tokens
 #define CR                  '\r'
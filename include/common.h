@@ -26,10 +26,18 @@
 #define COMMON_H
 
 #define ARG_NAMESIZE    12
-#define MAX_ARG_AMOUNT  2
+#define MAX_ARG_AMOUNT  3
 
 #define FILENAME_SIZE   12
-#define AMOUNT_OF_FILES 10
+// the directory on the EEPROM grows with the files, this limits the copy of it in RAM.
+// The converter uses the limits of both boards for the images it builds.
+#define MEGA_AMOUNT_OF_FILES    64
+#define UNO_AMOUNT_OF_FILES     10
+#if defined(__AVR_ATmega2560__)
+#define AMOUNT_OF_FILES MEGA_AMOUNT_OF_FILES
+#else
+#define AMOUNT_OF_FILES UNO_AMOUNT_OF_FILES
+#endif
 
 typedef struct {
     char arg[MAX_ARG_AMOUNT][ARG_NAMESIZE];
@@ -0,0 +1,57 @@
+/*
+ *
+ * ArduinOS - File I/O header file
+ * include/fileio.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <Arduino.h>
+#include "common.h"
+
+// files that can be open at the same time, every process can have one file open
+#if defined(__AVR_ATmega2560__)
+#define MAX_OPEN_FILES      4
+#else
+#define MAX_OPEN_FILES      2
+#endif
+// bytes of a file that are kept in RAM, reads and writes within them don't touch the EEPROM
+#define FILE_BUFFER_SIZE    16
+
+typedef struct {
+    int proc_id;        // process that opened the file, 0 when the slot is free
+    int addr;           // begin address of the file data
+    int size;
+    int pos;            // position in the file of the next read or write
+    int window;         // position in the file of the first byte in the buffer, -1 when empty
+    bool dirty;         // the buffer has changes that are not written to the EEPROM
+    uint8_t buffer[FILE_BUFFER_SIZE];
+} OpenFile;
+
+bool openFile(int proc_id);
+void closeFile(int proc_id);
+bool writeFile(int proc_id);
+bool readFile(uint8_t type, int proc_id);
+bool checkOpen(int addr);
+bool hasOpenFile(int proc_id);
+
+#endif
@@ -27,25 +27,144 @@
 
 #include "common.h"
 
-#define NOF_PTR         0
-#define FST_PTR         1
+#define FORMAT_PTR      0
+#define NOF_PTR         1
+#define FST_PTR         2
+// format byte of the filesystem, a new format gets a new value
+#define FS_FORMAT       0xA2
+// format byte while a filesystem of the first version is converted
+#define FS_CONVERTING   0xA1
+// the first version had no format byte: the number of files (at most 10) followed by FAT entries of a
+// name and a 2-byte address and size
+#define OLD_AMOUNT_OF_FILES 10
+#define OLD_FST_PTR     1
+#define OLD_ENTRY_SIZE  16
+// new files are stored behind room for this amount of extra FAT entries, so the FAT
+// can grow without moving the data of files that are in use
+#define FAT_RESERVE     4
+// the read-only volume in program memory has its own addresses, beyond the EEPROM
+#define ROM_FST_PTR     0x4000
+#define ROM_DATA_PTR    0x5000
+// the data area is divided in regions of which the writes are counted
+#define REGION_SIZE     128
+// at most 32 regions, a bit mask keeps the regions that changed
+#define MAX_REGIONS     ((E2END + 1) / REGION_SIZE)
+// the write counters are kept in RAM and saved to the EEPROM after this amount of counted writes
+#define WEAR_SAVE_INTERVAL 16
+
+// policies to pick the free space for a new file
+#define FIRST_FIT       0   // lowest address that fits
+#define BEST_FIT        1   // smallest free space that fits
+#define NEXT_FIT        2   // first fit after the previously stored file, spreads the writes
+#define FIT_POLICY      NEXT_FIT
+
+// compressed files are marked in their FAT entry. The data starts with the original size (big-endian), followed
+// by groups of a flag byte and 8 items. A set flag bit (LSB first) marks a back reference: 3 bits length - 2 and
+// 5 bits distance - 1 into the last LZ_WINDOW bytes of the original data, otherwise a literal byte.
+#define LZ_HEADER       2
+#define LZ_WINDOW       32
+#define LZ_MIN_LENGTH   2
+
+// binary retrieve sends frames of a length byte, up to RETRIEVE_CHUNK data bytes and the CRC-16 of the
+// data (big-endian). A frame with length 0 ends the file, its CRC is the CRC-16 of all data.
+#define RETRIEVE_CHUNK  32
+
+// bytes moved by defrag in every pass of the main loop
+#define DEFRAG_STEP     8
+
+// journal records are written to the slots in turn, so no cell is written for every FAT change
+#define JOURNAL_SLOTS   4
+// journal index of a change that only updates the number of files
+#define NO_ENTRY        0xFF
+// CRC in the FAT entry of a file that is being written by a process, computed when the file is closed or at boot
+#define CRC_UNCHECKED   0
+
+// flags of a file in its FAT entry
+#define FILE_COMPRESSED 0x01
 
 typedef struct {
     char name[FILENAME_SIZE];
     int addr;
     int size;
+    uint16_t crc;   // CRC-16 of the file data, checked at boot
+    uint8_t flags;  // FILE_COMPRESSED when the data is compressed
 } File;
 
+// free space on the EEPROM
+typedef struct {
+    int addr;
+    int size;
+} Extent;
+
+// file data that is being moved by defrag, stored on the EEPROM to resume after a reset
+typedef struct {
+    int from;   // begin address of the data, -1 when nothing is moved
+    int to;     // new begin address of the data
+    uint16_t steps; // amount of moved chunks, Gray coded so that every update changes one byte
+} Move;
+
+// change of the FAT that is written before the FAT itself, so it can be finished after a reset
+typedef struct {
+    File entry;             // new contents of the FAT entry
+    uint8_t index;          // index of the FAT entry, or NO_ENTRY
+    uint8_t no_of_files;    // new number of files
+    uint8_t sequence;       // one more than the previous record, the highest is the last change
+    uint16_t crc;           // CRC-16 of the fields above, a record that was written partly doesn't match
+} Journal;
+
+// progress of the conversion of a filesystem of the first version, stored in the journal slots. The entries
+// are converted from the last to the first, every entry is saved here before it is written to the FAT.
+typedef struct {
+    uint8_t no_of_files;
+    uint8_t done;       // FAT entries from this index on are converted, the entry is in entries[done % 2]
+    File entries[2];
+} Conversion;
+
+// programs that are started at boot
+#define AUTOSTART_SIZE  3
+#define AUTOSTART_TYPED 1
+
+// program in the autostart table
+typedef struct {
+    char name[FILENAME_SIZE];   // empty or erased when the slot is free
+    uint8_t typed;              // AUTOSTART_TYPED to translate the program to typed instructions
+} AutostartEntry;
+
+// settings that are kept on the EEPROM, an erased byte means the default
+typedef struct {
+    uint8_t baud;   // index in the supported baud rates
+    AutostartEntry autostart[AUTOSTART_SIZE];
+} Config;
+
+// read-only volume, generated with `convert -rom` in src/rom_files.cpp
+extern const uint8_t rom_data[] PROGMEM;
+extern const File rom_files[] PROGMEM;
+extern const uint8_t no_of_rom_files;
+
 void initFileSystem();
 int findFATEntry(const char *name);
 File readFATEntry(int addr);
 uint8_t readPcByte(int pc);
+bool isReadOnly(int addr);
+bool isCompressed(File file);
+int dataSize(File file);
+void readFileData(File file, uint8_t *data);
+int createFile(const char *name, int size, const uint8_t *data, uint8_t flags);
+bool removeFile(int f_addr);
+void updateFileData(int addr, const uint8_t *data, int size, bool update_crc);
+void updateFileCRC(int addr);
+Config readConfig();
+void writeConfig(Config config);
 
 void store(CommandArgs argv);
 void retrieve(CommandArgs argv);
 void erase(CommandArgs argv);
 void files(CommandArgs argv);
 void freespace(CommandArgs argv);
+void wear(CommandArgs argv);
+void defrag(CommandArgs argv);
+void runDefrag();
+bool checkMoving(int addr);
 
 // debug functions
 void debugResetEEPROM();
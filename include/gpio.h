@@ -0,0 +1,76 @@
+/*
+ *
+ * ArduinOS - GPIO header file
+ * include/gpio.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <Arduino.h>
+
+// pins of which every process keeps the port registers
+#define PIN_CACHE_SIZE  2
+
+// processes that can wait for a pin at the same time
+#define MAX_PIN_WAITS   4
+
+// registers of a port from its input register, PINx, DDRx and PORTx are consecutive on the AVR
+#define PIN_REG         0
+#define DDR_REG         1
+#define PORT_REG        2
+
+// port registers and bit of a pin, looked up once
+typedef struct {
+    volatile uint8_t *regs;     // input register of the port, NULL when the entry is unused
+    uint8_t mask;
+    uint8_t pin;
+} PinCache;
+
+// process that waits until a pin has a level
+typedef struct {
+    int proc_id;                // process that waits, 0 when the entry is unused
+    volatile uint8_t *regs;     // input register of the port
+    uint8_t mask;
+    uint8_t level;              // the mask when waiting for HIGH, 0 for LOW
+    uint8_t pin;
+    bool interrupt;             // checked by the pin change interrupt, otherwise polled
+    volatile bool woken;        // the pin had the level
+} PinWait;
+
+bool gpioPinMode(PinCache *cache, int pin, int mode);
+bool gpioDigitalWrite(PinCache *cache, int pin, int value);
+bool gpioDigitalRead(PinCache *cache, int pin, uint8_t *value);
+bool gpioAnalogWrite(int pin, int value);
+bool gpioAnalogRead(int pin, int *value);
+void gpioForget(PinCache *cache, int pin);
+int gpioWaitPin(PinCache *cache, int proc_id, int pin, int level);
+int gpioWoken();
+bool gpioWaiting(int proc_id);
+void gpioCancelWait(int proc_id);
+
+#ifndef __AVR__
+// debug functions for the simulated pin bank
+void debugSetPin(int pin, uint8_t level);
+uint8_t debugGetPin(int pin);
+#endif
+
+#endif
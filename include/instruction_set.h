@@ -57,6 +57,9 @@
 #define READCHAR 57
 #define READFLOAT 58
 #define READSTRING 59
+#define WAITPIN 60
+#define SEND 61
+#define RECV 62
 #define IF 128
 #define ELSE 129
 #define ENDIF 130
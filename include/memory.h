@@ -27,7 +27,11 @@
 
 #include <Arduino.h>
 
+#if defined(__AVR_ATmega2560__)
 #define MAX_VAR_AMOUNT  25
+#else
+#define MAX_VAR_AMOUNT  16
+#endif
 #define MEM_SIZE        256
 
 typedef struct {
@@ -38,10 +42,14 @@ typedef struct {
     int proc_id;
 } Variable;
 
-void setVar(char name, int proc_id);
-void getVar(char name, int proc_id);
+bool setVar(char name, int proc_id);
+bool setVarUntagged(char name, uint8_t type, int proc_id);
+bool getVar(char name, int proc_id);
+bool getVarUntagged(char name, int proc_id);
 void clearVar(char name, int proc_id);
 void clearAllVars(int proc_id);
+int packVars(int proc_id, uint8_t *out, uint8_t *count);
+bool unpackVars(int proc_id, const uint8_t *in, uint8_t count);
 
 // debug functions
 void debugPrintMemoryTable();
@@ -0,0 +1,65 @@
+/*
+ *
+ * ArduinOS - Message queue header file
+ * include/message.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <Arduino.h>
+
+// queues that processes can send values to, numbered from 0
+#if defined(__AVR_ATmega2560__)
+#define MESSAGE_QUEUES      4
+#else
+#define MESSAGE_QUEUES      2
+#endif
+// bytes of every queue, every message takes its length byte and the value with its type
+#define QUEUE_SIZE          32
+// longest value that fits in a queue
+#define MAX_MESSAGE_SIZE    (QUEUE_SIZE - 1)
+// processes that can wait for a queue at the same time
+#define MAX_MESSAGE_WAITS   4
+
+// ring of messages
+typedef struct {
+    uint8_t buffer[QUEUE_SIZE];
+    uint8_t head;               // index of the length byte of the oldest message
+    uint8_t length;             // bytes in use
+} MessageQueue;
+
+// process that waits until it can send to or receive from a queue
+typedef struct {
+    int proc_id;                // process that waits, 0 when the entry is unused
+    uint8_t queue;
+    uint8_t needed;             // free bytes a sender waits for, 0 for a receiver
+} MessageWait;
+
+bool messageFits(uint8_t queue, uint8_t length);
+void messageSend(uint8_t queue, const uint8_t *data, uint8_t length);
+uint8_t messageReceive(uint8_t queue, uint8_t *data);
+bool messageWait(uint8_t queue, int proc_id, uint8_t needed);
+int messageWoken();
+bool messageWaiting(int proc_id);
+void messageCancelWait(int proc_id);
+
+#endif
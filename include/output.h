@@ -0,0 +1,57 @@
+/*
+ *
+ * ArduinOS - Output header file
+ * include/output.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <Arduino.h>
+
+// bytes of output a process can have waiting for the serial port, fits the longest value on the stack and a newline
+#define OUTPUT_SIZE     32
+// longest printed int and float, including the sign
+#define INT_DIGITS      6
+#define FLOAT_DIGITS    14
+
+// output of a process that is not written to the serial port yet
+typedef struct {
+    uint8_t *buffer;    // OUTPUT_SIZE bytes, allocated on the first print
+    uint8_t head;       // index of the oldest byte
+    uint8_t length;
+} OutputRing;
+
+// Print destination that writes into an output ring, the caller makes sure the output fits.
+class OutputPrint : public Print {
+public:
+    OutputPrint(OutputRing *ring) : ring(ring) {}
+    size_t write(uint8_t b);
+private:
+    OutputRing *ring;
+};
+
+uint8_t outputFree(OutputRing *ring);
+bool outputAllocate(OutputRing *ring);
+int outputRead(OutputRing *ring);
+void outputRelease(OutputRing *ring);
+
+#endif
@@ -27,10 +27,20 @@
 
 #include "common.h"
 #include "stack.h"
+#include "gpio.h"
+#include "output.h"
+
+// the Uno has 2KB of RAM, every process takes about 100 bytes of it
+#if defined(__AVR_ATmega2560__)
+#define MAX_PROCESSES       10
+#else
+#define MAX_PROCESSES       4
+#endif
 
 typedef enum {
     running = 'r',
     paused = 'p',
+    blocked = 'b',      // waiting for a pin or a message queue
     terminated = 0
 } State;
 
@@ -39,14 +49,38 @@ typedef struct {
     int id;
     State state;
     int pc;
+    int base;                     // begin address of the program
+    int size;                     // size of the program, the pc has to stay below base + size
+    uint8_t *code;                // translated program in RAM, or NULL when executed from EEPROM
     uint8_t sp;
     int fp;
     uint8_t stack[STACKSIZE];
+    PinCache pins[PIN_CACHE_SIZE];  // port registers of the pins used last
+    OutputRing output;              // printed values waiting for the serial port
+    uint8_t output_wait;            // free bytes in the output ring needed to continue
+    // accounting
+    unsigned long instructions;   // amount of executed instructions
+    unsigned long run_time;       // time spent executing instructions in microseconds
+    unsigned long wait_time;      // time spent sleeping or blocked in milliseconds
+    unsigned long start_time;     // millis() at process creation
+    unsigned long state_time;     // millis() at last state change
+    uint8_t sp_max;               // stack pointer high-water mark
+    bool trace;                   // record executed instructions in the trace buffer
+    bool verified;                // stack usage is verified, skip the stack bounds checks
+    bool typed;                   // executes the program translated to typed instructions
 } Process;
 
 void runProcesses();
+void drainOutput();
 int checkRunning(int proc_id);
+Process *findProcess(int proc_id);
+bool checkExecuting(int addr);
 void changeProcessStatus(int proc_id, State status);
+bool toggleTrace(int proc_id);
+bool instructionValid(uint8_t instruction);
+bool instructionSupported(uint8_t instruction);
+
+int startProcess(const char *file_name, bool typed);
 
 void run(CommandArgs argv);
 void list(CommandArgs argv);
@@ -56,5 +90,6 @@ void kill(CommandArgs argv);
 
 void pushByte(uint8_t b, int id);
 uint8_t popByte(int id);
+uint8_t readProgramByte(int offset, int id);
 
 #endif
\ No newline at end of file
@@ -29,11 +29,16 @@
 
 #define STACKSIZE   32
 
+// type of a string literal that stays in the program, only its offset in the program and size are on the stack
+#define STRING_REF      5
+#define STRING_REF_SIZE 3
+
 void pushByte(uint8_t b, int id);
 void pushChar(char c, int id);
 void pushInt(int i, int id);
 void pushFloat(float f, int id);
 void pushString(const char *s, int id);
+void pushStringRef(int offset, uint8_t size, int id);
 
 uint8_t popByte(int id);
 char popChar(int id);
@@ -41,8 +46,11 @@ int popInt(int id);
 float popFloat(int id);
 float popVal(uint8_t type, int id);
 void popString(char *s, int size, int id);
+int popStringRef(uint8_t *size, int id);
 
-void printVal(uint8_t t, int id);
+void printVal(uint8_t t, int id, Print &out);
+void printUntagged(uint8_t t, uint8_t type, int id, Print &out);
 void unaryOperation(uint8_t t, int id);
+void unaryUntagged(uint8_t t, uint8_t type, int id);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+/*
+ *
+ * ArduinOS - Trace header file
+ * include/trace.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "common.h"
+
+// amount of records in the ring buffer, should be a power of 2
+#if defined(__AVR_ATmega2560__)
+#define TRACE_SIZE  16
+#else
+#define TRACE_SIZE  8
+#endif
+
+typedef struct {
+    uint8_t pid;
+    int pc;
+    uint8_t opcode;
+    uint8_t sp;
+    unsigned long micros;
+} TraceRecord;
+
+void traceRecord(uint8_t pid, int pc, uint8_t opcode, uint8_t sp);
+void traceDump();
+
+void trace(CommandArgs argv);
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ *
+ * ArduinOS - Verifier header file
+ * include/verifier.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <Arduino.h>
+
+#define MAX_BLOCK_DEPTH     8   // nesting of IF, WHILE and LOOP blocks
+#define MAX_STACK_VALUES    16  // values on the stack, the smallest value takes 2 bytes
+#define MAX_VERIFY_VARS     8   // variables of which the type is tracked
+#define RECENT_INSTRUCTIONS 16  // instruction addresses kept for backward jumps
+
+// Instructions of translated programs, which carry the type of their operand.
+// Values of a translated program are on the stack without their type.
+#define TYPED_BASE          0xC0
+#define TYPED_AMOUNT        28
+#define TYPED_LITERAL       0
+#define TYPED_SET           1
+#define TYPED_GET           2
+#define TYPED_PRINT         3
+#define TYPED_PRINTLN       4
+#define TYPED_INCREMENT     5
+#define TYPED_DECREMENT     6
+
+#define TYPED(kind, type)   (TYPED_BASE | ((kind) << 2) | ((type) - 1))
+#define TYPED_KIND(typed)   (((typed) >> 2) & 0x0F)
+#define TYPED_TYPE(typed)   (((typed) & 0x03) + 1)
+
+typedef struct {
+    bool valid;         // the program is well formed and can be executed
+    bool bounded;       // the stack usage is known and fits on the stack
+    uint8_t max_stack;  // highest stack pointer the program can reach, when bounded
+    bool typed;         // the program is translated to typed instructions
+} Verification;
+
+Verification verifyProgram(int addr, int size, const uint8_t *program, uint8_t *code);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ *
+ * ArduinOS - Autostart source file
+ * src/autostart.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "common.h"
+#include "autostart.h"
+#include "filesystem.h"
+#include "processes.h"
+
+// Check if a slot of the autostart table holds a program, erased slots start with 0xFF.
+static bool slotUsed(const AutostartEntry *entry)
+{
+    return entry->name[0] != '\0' && (uint8_t)entry->name[0] != 0xFF;
+}
+
+/**
+ * Start the programs in the autostart table. The programs are verified, and translated when requested,
+ * and their first instruction is executed before anything else is printed.
+ */
+void bootProcesses()
+{
+    Config config = readConfig();
+    uint8_t started = 0;
+    for (uint8_t i = 0; i < AUTOSTART_SIZE; i++) {
+        AutostartEntry *entry = &config.autostart[i];
+        if (!slotUsed(entry))
+            continue;
+        entry->name[FILENAME_SIZE - 1] = '\0';
+        if (startProcess(entry->name, entry->typed == AUTOSTART_TYPED) > 0)
+            started++;
+    }
+    if (started == 0)
+        return;
+
+    unsigned long first_instruction = micros();
+    runProcesses();
+
+    Serial.print(F("Started "));
+    Serial.print(started);
+    Serial.print(F(" programs, first instruction after "));
+    Serial.print(first_instruction);
+    Serial.println(F(" us."));
+}
+
+/**
+ * Show the programs that are started at boot, or add a program to them. With "typed" as second argument
+ * the program is translated to typed instructions, with "off" it is removed.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void autostart(CommandArgs argv)
+{
+    Config config = readConfig();
+    if (strlen(argv.arg[0]) == 0) {
+        bool any = false;
+        for (uint8_t i = 0; i < AUTOSTART_SIZE; i++) {
+            AutostartEntry *entry = &config.autostart[i];
+            if (!slotUsed(entry))
+                continue;
+            entry->name[FILENAME_SIZE - 1] = '\0';
+            Serial.print(entry->name);
+            if (entry->typed == AUTOSTART_TYPED)
+                Serial.print(F(", typed"));
+            Serial.println();
+            any = true;
+        }
+        if (!any)
+            Serial.println(F("No programs are started at boot."));
+        return;
+    }
+
+    // the slot of the program, or a free slot
+    int slot = -1;
+    int free_slot = -1;
+    for (uint8_t i = 0; i < AUTOSTART_SIZE; i++) {
+        if (!slotUsed(&config.autostart[i])) {
+            if (free_slot < 0) 
+                free_slot = i;
+        }
+        else if (strncmp(config.autostart[i].name, argv.arg[0], FILENAME_SIZE) == 0) {
+            slot = i;
+        }
+    }
+
+    if (strcmp(argv.arg[1], "off") == 0) {
+        if (slot < 0) {
+            Serial.print(F("Error: program \""));
+            Serial.print(argv.arg[0]);
+            Serial.println(F("\" is not started at boot."));
+            return;
+        }
+        // only the first byte is written
+        config.autostart[slot].name[0] = '\0';
+        writeConfig(config);
+        Serial.print(F("Program \""));
+        Serial.print(argv.arg[0]);
+        Serial.println(F("\" is not started at boot anymore."));
+        return;
+    }
+
+    if (findFATEntry(argv.arg[0]) < 0) {
+        Serial.print(F("Error: file \""));
+        Serial.print(argv.arg[0]);
+        Serial.println(F("\" not found in filesystem."));
+        return;
+    }
+    if (slot < 0)
+        slot = free_slot;
+    if (slot < 0) {
+        Serial.println(F("Error: no space left in the autostart table."));
+        return;
+    }
+
+    AutostartEntry *entry = &config.autostart[slot];
+    memset(entry->name, 0, FILENAME_SIZE);
+    strncpy(entry->name, argv.arg[0], FILENAME_SIZE - 1);
+    entry->typed = (strcmp(argv.arg[1], "typed") == 0) ? AUTOSTART_TYPED : 0;
+    writeConfig(config);
+    Serial.print(F("Program \""));
+    Serial.print(argv.arg[0]);
+    Serial.println(F("\" is started at boot."));
+}
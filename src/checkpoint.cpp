@@ -0,0 +1,326 @@
+/*
+ *
+ * ArduinOS - Checkpoint source file
+ * src/checkpoint.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "common.h"
+#include "checkpoint.h"
+#include "filesystem.h"
+#include "fileio.h"
+#include "memory.h"
+#include "processes.h"
+
+static AutoCheckpoint auto_checkpoints[MAX_AUTO_CHECKPOINTS];
+
+/**
+ * Get the name of the checkpoint file of a program. The name of the program is not shortened, programs
+ * with the same begin would share their checkpoint file.
+ * 
+ * @param program name of the program.
+ * @param name buffer of FILENAME_SIZE chars for the name of the checkpoint file.
+ * @return true when the name fits, false otherwise.
+ */
+static bool checkpointName(const char *program, char *name)
+{
+    if (strlen(program) > CHECKPOINT_NAME_SIZE) {
+        Serial.print(F("Error: the name of program \""));
+        Serial.print(program);
+        Serial.print(F("\" is longer than "));
+        Serial.print(CHECKPOINT_NAME_SIZE);
+        Serial.println(F(" characters, it can not be saved."));
+        return false;
+    }
+    strcpy(name, program);
+    strcat(name, ".ck");
+    return true;
+}
+
+/**
+ * Save the state of a process in its checkpoint file. When the file exists and is big enough,
+ * only the bytes that changed since the last checkpoint are written.
+ * 
+ * @param proc_id the id of the process.
+ * @param name set to the name of the checkpoint file.
+ * @return true when the process is saved, false otherwise.
+ */
+static bool saveCheckpoint(int proc_id, char *name)
+{
+    Process *process = findProcess(proc_id);
+    if (process == NULL) {
+        Serial.print(F("Error: no process found with id "));
+        Serial.println(proc_id);
+        return false;
+    }
+    // the wait and the open file are not part of the checkpoint
+    if (process->state == blocked || hasOpenFile(proc_id)) {
+        Serial.print(F("Error: process "));
+        Serial.print(proc_id);
+        if (process->state == blocked)
+            Serial.println(F(" is blocked."));
+        else
+            Serial.println(F(" has a file opened."));
+        return false;
+    }
+    int program_addr = findFATEntry(process->name);
+    if (program_addr < 0) {
+        Serial.print(F("Error: file \""));
+        Serial.print(process->name);
+        Serial.println(F("\" not found in filesystem."));
+        return false;
+    }
+    File program = readFATEntry(program_addr);
+    if (!checkpointName(program.name, name))
+        return false;
+
+    uint8_t no_of_vars;
+    int size = sizeof(Checkpoint) + process->sp + packVars(proc_id, NULL, &no_of_vars);
+    uint8_t *data = (uint8_t*)calloc(size + CHECKPOINT_SLACK, 1);
+    if (data == NULL) {
+        Serial.println(F("Error: not enough RAM to save the process."));
+        return false;
+    }
+
+    Checkpoint header = {0};
+    header.magic = CHECKPOINT_MAGIC;
+    strcpy(header.program, program.name);
+    header.program_size = program.size;
+    header.program_crc = program.crc;
+    header.pc = process->pc - process->base;
+    header.typed = process->typed;
+    header.state = process->state;
+    header.sp = process->sp;
+    header.no_of_vars = no_of_vars;
+    memcpy(data, &header, sizeof(Checkpoint));
+    memcpy(data + sizeof(Checkpoint), process->stack, process->sp);
+    packVars(proc_id, data + sizeof(Checkpoint) + process->sp, &no_of_vars);
+
+    int f_addr = findFATEntry(name);
+    if (f_addr >= 0) {
+        File file = readFATEntry(f_addr);
+        if (file.size >= size && !isReadOnly(f_addr) && !isCompressed(file) 
+                && !checkMoving(file.addr) && !checkOpen(file.addr)) {
+            updateFileData(file.addr, data, size, true);
+            free(data);
+            return true;
+        }
+        // the file is too small, a new one is created
+        if (!removeFile(f_addr)) {
+            free(data);
+            return false;
+        }
+    }
+    bool created = createFile(name, size + CHECKPOINT_SLACK, data, 0) >= 0;
+    free(data);
+    return created;
+}
+
+// Change the interval of the periodic checkpoints of a process, 0 stops them.
+static bool setAutoCheckpoint(int proc_id, uint16_t interval)
+{
+    AutoCheckpoint *slot = NULL;
+    for (uint8_t i = 0; i < MAX_AUTO_CHECKPOINTS; i++) {
+        if (auto_checkpoints[i].proc_id == proc_id) {
+            slot = &auto_checkpoints[i];
+            break;
+        }
+        if (slot == NULL && auto_checkpoints[i].proc_id == 0)
+            slot = &auto_checkpoints[i];
+    }
+    if (interval == 0) {
+        if (slot != NULL && slot->proc_id == proc_id)
+            slot->proc_id = 0;
+        return true;
+    }
+    if (slot == NULL) {
+        Serial.println(F("Error: no space left in the checkpoint table."));
+        return false;
+    }
+    slot->proc_id = proc_id;
+    slot->interval = interval;
+    slot->last = millis();
+    return true;
+}
+
+// Save the processes of which the checkpoint interval passed. Stopped processes are removed from the table.
+void runCheckpoints()
+{
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < MAX_AUTO_CHECKPOINTS; i++) {
+        AutoCheckpoint *entry = &auto_checkpoints[i];
+        if (entry->proc_id == 0)
+            continue;
+        Process *process = findProcess(entry->proc_id);
+        if (process == NULL) {
+            entry->proc_id = 0;
+            continue;
+        }
+        // a blocked process or one that has a file opened is saved as soon as it can continue
+        if (now - entry->last < entry->interval * 1000UL || process->state == blocked || hasOpenFile(entry->proc_id))
+            continue;
+
+        char name[FILENAME_SIZE];
+        entry->last = now;
+        if (!saveCheckpoint(entry->proc_id, name)) {
+            Serial.print(F("Process "));
+            Serial.print(entry->proc_id);
+            Serial.println(F(" is not saved periodically anymore."));
+            entry->proc_id = 0;
+        }
+    }
+}
+
+/**
+ * Save the state of a process in a file, so it can be resumed after a reset. With a second argument
+ * the process is saved every amount of seconds, 0 stops this.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void checkpoint(CommandArgs argv)
+{
+    int proc_id = atoi(argv.arg[0]);
+    if (proc_id <= 0) {
+        // no argument given, value below 0, atoi failed
+        Serial.println(F("Error: invalid id provided."));
+        return;
+    }
+    int interval = atoi(argv.arg[1]);
+    if (interval < 0) {
+        Serial.println(F("Error: invalid interval provided."));
+        return;
+    }
+
+    char name[FILENAME_SIZE];
+    if (strlen(argv.arg[1]) > 0 && interval == 0) {
+        setAutoCheckpoint(proc_id, 0);
+        Serial.print(F("Process "));
+        Serial.print(proc_id);
+        Serial.println(F(" is not saved periodically anymore."));
+        return;
+    }
+    if (!saveCheckpoint(proc_id, name))
+        return;
+    Serial.print(F("Process "));
+    Serial.print(proc_id);
+    Serial.print(F(" is saved in \""));
+    Serial.print(name);
+    Serial.println('"');
+
+    if (interval > 0 && setAutoCheckpoint(proc_id, interval)) {
+        Serial.print(F("Process "));
+        Serial.print(proc_id);
+        Serial.print(F(" is saved every "));
+        Serial.print(interval);
+        Serial.println(F(" seconds."));
+    }
+}
+
+/**
+ * Start a process from a checkpoint file. The program is started again and resumes at the saved instruction,
+ * with the saved stack and variables.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void restore(CommandArgs argv)
+{
+    if (strlen(argv.arg[0]) == 0) {
+        Serial.println(F("Error: the filename argument is required."));
+        return;
+    }
+    int f_addr = findFATEntry(argv.arg[0]);
+    if (f_addr < 0) {
+        Serial.print(F("Error: file \""));
+        Serial.print(argv.arg[0]);
+        Serial.println(F("\" not found in filesystem."));
+        return;
+    }
+    File file = readFATEntry(f_addr);
+    int size = dataSize(file);
+    uint8_t *data = (size >= (int)sizeof(Checkpoint)) ? (uint8_t*)malloc(size) : NULL;
+    if (data != NULL)
+        readFileData(file, data);
+
+    Checkpoint header;
+    if (data != NULL)
+        memcpy(&header, data, sizeof(Checkpoint));
+    if (data == NULL || header.magic != CHECKPOINT_MAGIC || header.sp > STACKSIZE 
+            || (int)sizeof(Checkpoint) + header.sp > size) {
+        Serial.print(F("Error: file \""));
+        Serial.print(argv.arg[0]);
+        Serial.println(F("\" is not a checkpoint."));
+        free(data);
+        return;
+    }
+    header.program[FILENAME_SIZE - 1] = '\0';
+
+    // the saved program counter and stack only fit the same program
+    int program_addr = findFATEntry(header.program);
+    if (program_addr >= 0) {
+        File program = readFATEntry(program_addr);
+        if (program.size != header.program_size || program.crc != header.program_crc) {
+            Serial.print(F("Error: program \""));
+            Serial.print(header.program);
+            Serial.println(F("\" was changed after the checkpoint."));
+            free(data);
+            return;
+        }
+        if (header.pc < 0 || header.pc >= dataSize(program)) {
+            Serial.print(F("Error: file \""));
+            Serial.print(argv.arg[0]);
+            Serial.println(F("\" has a program counter outside the program."));
+            free(data);
+            return;
+        }
+    }
+    int proc_id = startProcess(header.program, header.typed);
+    if (proc_id < 0) {
+        free(data);
+        return;
+    }
+
+    Process *process = findProcess(proc_id);
+    process->pc = process->base + header.pc;
+    process->sp = header.sp;
+    process->sp_max = header.sp;
+    // the verifier only checked the stack usage from the begin of the program
+    process->verified = false;
+    memcpy(process->stack, data + sizeof(Checkpoint), header.sp);
+    bool restored = process->typed == (bool)header.typed
+        && unpackVars(proc_id, data + sizeof(Checkpoint) + header.sp, header.no_of_vars);
+    free(data);
+    if (!restored) {
+        Serial.print(F("Error: process "));
+        Serial.print(proc_id);
+        Serial.println(F(" can not be restored."));
+        clearAllVars(proc_id);
+        changeProcessStatus(proc_id, terminated);
+        return;
+    }
+    if (header.state == paused)
+        changeProcessStatus(proc_id, paused);
+
+    Serial.print(F("Process "));
+    Serial.print(proc_id);
+    Serial.print(F(" is restored from \""));
+    Serial.print(argv.arg[0]);
+    Serial.println('"');
+}
@@ -27,6 +27,10 @@
 #include "cli.h"
 #include "filesystem.h"
 #include "processes.h"
+#include "trace.h"
+#include "console.h"
+#include "autostart.h"
+#include "checkpoint.h"
 
 typedef struct {
     char name[COMMAND_NAMESIZE];
@@ -45,11 +49,18 @@ static const CommandType command[] PROGMEM = {
     {ERASE, &erase},
     {FILES, &files},
     {FREESPACE, &freespace},
+    {WEAR, &wear},
+    {DEFRAG, &defrag},
     {RUN, &run},
     {LIST, &list},
     {SUSPEND, &suspend},
     {RESUME, &resume},
     {KILL, &kill},
+    {TRACE, &trace},
+    {BAUD, &baud},
+    {AUTOSTART, &autostart},
+    {CHECKPOINT, &checkpoint},
+    {RESTORE, &restore},
 };
 
 // Parse given CLI commands.
@@ -152,16 +163,23 @@ void help(CommandArgs argv)
         "Usage: (command) (arg) ...\n"
         "\n"
         "Commands:\n"
-        "store\t\t<file> <size> <data>\tStore a file in the filesystem.\n"
-        "retrieve\t<file>\t\t\tRequest a file from the filesystem.\n"
+        "store\t\t<file> <size> [z]\tStore the data that follows in a file, z when the data is compressed.\n"
+        "retrieve\t<file> [binary]\t\tRequest a file from the filesystem, optionally as CRC checked frames.\n"
         "erase\t\t<file>\t\t\tErase a file.\n"
         "files\t\t\t\t\tList all files in the filesystem.\n"
         "freespace\t\t\t\tShow the amount of free space in the filesystem.\n"
-        "run\t\t<file>\t\t\tRun a program.\n"
-        "list\t\t\t\t\tShow a list with all processes.\n"
+        "wear\t\t\t\t\tShow the amount of writes for every EEPROM region.\n"
+        "defrag\t\t\t\t\tMove all file data together, behind the FAT.\n"
+        "run\t\t<file> [typed]\t\tRun a program, optionally translated to typed instructions.\n"
+        "list\t\t[cpu]\t\t\tShow a list with all processes.\n"
         "suspend\t\t<id>\t\t\tSuspend a process.\n"
         "resume\t\t<id>\t\t\tResume a process.\n"
-        "kill\t\t<id>\t\t\tKill a process."
+        "kill\t\t<id>\t\t\tKill a process.\n"
+        "trace\t\t[id]\t\t\tDump the trace buffer, or toggle tracing for a process.\n"
+        "baud\t\t[rate]\t\t\tShow the baud rate, or switch to 9600, 115200, 250000 or 500000.\n"
+        "autostart\t[file] [typed|off]\tShow or change the programs that are started at boot.\n"
+        "checkpoint\t<id> [seconds]\t\tSave a process in a file, optionally every amount of seconds.\n"
+        "restore\t\t<file>\t\t\tResume a process that was saved by checkpoint."
         "\n"
     ));
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+ *
+ * ArduinOS - Console source file
+ * src/console.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "common.h"
+#include "console.h"
+#include "filesystem.h"
+
+static const unsigned long baud_rates[] PROGMEM = {9600, 115200, 250000, 500000};
+static uint8_t current_baud = DEFAULT_BAUD;
+
+// Baud rate of an index in the supported baud rates.
+static unsigned long baudRate(uint8_t index)
+{
+    return pgm_read_dword(&baud_rates[index]);
+}
+
+// Start the serial port at the baud rate in the config block.
+void beginConsole()
+{
+    Config config = readConfig();
+    if (config.baud < sizeof(baud_rates) / sizeof(baud_rates[0]))
+        current_baud = config.baud;
+    Serial.begin(baudRate(current_baud));
+}
+
+/**
+ * Wait until the host sends "ok" at the new baud rate. Bytes received while the host still uses the old
+ * baud rate are garbage, so nothing else confirms the switch.
+ * 
+ * @return true when confirmed, false after BAUD_CONFIRM_TIME milliseconds.
+ */
+static bool confirmBaud()
+{
+    const char *token = "ok";
+    uint8_t matched = 0;
+    unsigned long start = millis();
+    while (millis() - start < BAUD_CONFIRM_TIME) {
+        int c = Serial.read();
+        if (c < 0)
+            continue;
+        if (c == token[matched])
+            matched++;
+        else 
+            matched = (c == token[0]) ? 1 : 0;
+        if (token[matched] == '\0')
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Switch the serial port to another baud rate. The host has to confirm the switch by sending "ok" at
+ * the new baud rate, otherwise the old baud rate is used again. A confirmed baud rate is kept in the
+ * config block and used after a reset.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void baud(CommandArgs argv)
+{
+    if (strlen(argv.arg[0]) == 0) {
+        Serial.print(F("Baud rate: "));
+        Serial.print(baudRate(current_baud));
+        Serial.println(F("."));
+        return;
+    }
+
+    unsigned long rate = strtoul(argv.arg[0], NULL, 10);
+    uint8_t index = 0;
+    while (index < sizeof(baud_rates) / sizeof(baud_rates[0]) && baudRate(index) != rate) {
+        index++;
+    }
+    if (index == sizeof(baud_rates) / sizeof(baud_rates[0])) {
+        Serial.println(F("Error: the baud rate should be 9600, 115200, 250000 or 500000."));
+        return;
+    }
+
+    Serial.print(F("Switching to "));
+    Serial.print(rate);
+    Serial.println(F(" baud, send \"ok\" at the new baud rate to confirm."));
+    Serial.flush();
+    Serial.begin(rate);
+
+    if (!confirmBaud()) {
+        Serial.flush();
+        Serial.begin(baudRate(current_baud));
+        Serial.print(F("Error: the new baud rate was not confirmed, using "));
+        Serial.print(baudRate(current_baud));
+        Serial.println(F(" baud."));
+        return;
+    }
+
+    current_baud = index;
+    Config config = readConfig();
+    config.baud = index;
+    writeConfig(config);
+    Serial.print(F("Baud rate set to "));
+    Serial.print(rate);
+    Serial.println(F("."));
+}
@@ -0,0 +1,313 @@
+/*
+ *
+ * ArduinOS - File I/O source file
+ * src/fileio.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "common.h"
+#include "fileio.h"
+#include "filesystem.h"
+#include "instruction_set.h"
+#include "processes.h"
+
+static OpenFile open_files[MAX_OPEN_FILES];
+
+// Find the file a process has opened, or NULL.
+static OpenFile *findOpenFile(int proc_id)
+{
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (open_files[i].proc_id == proc_id) {
+            return &open_files[i];
+        }
+    }
+    return NULL;
+}
+
+// Write the changes in the buffer to the EEPROM, as one block.
+static void flushFile(OpenFile *file)
+{
+    if (!file->dirty)
+        return;
+    updateFileData(file->addr + file->window, file->buffer, min(FILE_BUFFER_SIZE, file->size - file->window), false);
+    file->dirty = false;
+}
+
+// Make sure the buffer holds the bytes around the current position. The buffer starts at a multiple of its size.
+static void loadWindow(OpenFile *file)
+{
+    int window = file->pos - (file->pos % FILE_BUFFER_SIZE);
+    if (window == file->window)
+        return;
+
+    flushFile(file);
+    file->window = window;
+    for (int i = 0; i < FILE_BUFFER_SIZE && window + i < file->size; i++) {
+        file->buffer[i] = readPcByte(file->addr + window + i);
+    }
+}
+
+// Read the next byte of a file, reading beyond the end of the file gives 0.
+static uint8_t readByte(OpenFile *file)
+{
+    if (file->pos >= file->size)
+        return 0;
+    loadWindow(file);
+    return file->buffer[file->pos++ - file->window];
+}
+
+// Write the next byte of a file. Returns false when the file is full.
+static bool writeByte(OpenFile *file, uint8_t b)
+{
+    if (file->pos >= file->size) {
+        Serial.println(F("Error: cannot write beyond the end of the file."));
+        return false;
+    }
+    loadWindow(file);
+    file->buffer[file->pos++ - file->window] = b;
+    file->dirty = true;
+    return true;
+}
+
+/**
+ * Open a file for a process, the name and size are popped from the stack. A size of 0 opens an existing file,
+ * otherwise a new file of that size is created. An existing file with the same name is replaced.
+ * 
+ * @param proc_id the process id of the process.
+ * @return true when the file is opened, false otherwise.
+ */
+bool openFile(int proc_id)
+{
+    uint8_t type = popByte(proc_id);
+    if (type != CHAR && type != INT && type != FLOAT) {
+        Serial.println(F("Error: the size of a file should be a number."));
+        return false;
+    }
+    int size = (int)popVal(type, proc_id);
+    type = popByte(proc_id);
+    if (type != STRING && type != STRING_REF) {
+        Serial.println(F("Error: the name of a file should be a string."));
+        return false;
+    }
+    uint8_t length;
+    char *name;
+    if (type == STRING_REF) {
+        int offset = popStringRef(&length, proc_id);
+        name = (char*)malloc(length);
+        for (uint8_t i = 0; i < length; i++) {
+            name[i] = readProgramByte(offset + i, proc_id);
+        }
+    }
+    else {
+        length = popByte(proc_id);
+        name = (char*)malloc(length);
+        popString(name, length, proc_id);
+    }
+
+    // a process only has one file opened
+    closeFile(proc_id);
+    OpenFile *file = findOpenFile(0);
+    if (file == NULL) {
+        Serial.println(F("Error: too many open files."));
+        free(name);
+        return false;
+    }
+
+    int f_addr = findFATEntry(name);
+    if (size > 0) {
+        if ((f_addr >= 0 && !removeFile(f_addr)) || createFile(name, size, NULL, 0) < 0) {
+            free(name);
+            return false;
+        }
+        f_addr = findFATEntry(name);
+    }
+    else if (f_addr < 0) {
+        Serial.print(F("Error: file \""));
+        Serial.print(name);
+        Serial.println(F("\" not found in filesystem."));
+        free(name);
+        return false;
+    }
+    else if (checkMoving(readFATEntry(f_addr).addr)) {
+        // writes would go to the old copy, which defrag replaces when the move is finished
+        Serial.print(F("Error: file \""));
+        Serial.print(name);
+        Serial.println(F("\" is being moved by defrag."));
+        free(name);
+        return false;
+    }
+    else if (isCompressed(readFATEntry(f_addr))) {
+        Serial.println(F("Error: compressed files can not be opened."));
+        free(name);
+        return false;
+    }
+    free(name);
+
+    File entry = readFATEntry(f_addr);
+    file->proc_id = proc_id;
+    file->addr = entry.addr;
+    file->size = entry.size;
+    file->pos = 0;
+    file->window = -1;
+    file->dirty = false;
+    return true;
+}
+
+/**
+ * Close the file a process has opened, and write its changes to the EEPROM.
+ * 
+ * @param proc_id the process id of the process.
+ */
+void closeFile(int proc_id)
+{
+    OpenFile *file = findOpenFile(proc_id);
+    if (file == NULL)
+        return;
+    flushFile(file);
+    updateFileCRC(file->addr);
+    file->proc_id = 0;
+}
+
+/**
+ * Pop a value from the stack and write it to the open file of a process. Numbers are written
+ * big-endian like in the bytecode, strings without their terminating null char.
+ * 
+ * @param proc_id the process id of the process.
+ * @return true when the value is written, false otherwise.
+ */
+bool writeFile(int proc_id)
+{
+    uint8_t type = popByte(proc_id);
+    if (type == 0 || type > STRING_REF) {
+        Serial.println(F("Error: no value to write."));
+        return false;
+    }
+    // a string literal is written straight from the program
+    int offset = -1;
+    uint8_t size = type;
+    if (type == STRING_REF)
+        offset = popStringRef(&size, proc_id);
+    else if (type == STRING)
+        size = popByte(proc_id);
+    // a value on the stack is never bigger than the stack
+    uint8_t bytes[STACKSIZE];
+    if (offset < 0 && size > STACKSIZE) {
+        Serial.println(F("Error: value is bigger than the stack."));
+        return false;
+    }
+    for (int i = size - 1; i >= 0 && offset < 0; i--) {
+        bytes[i] = popByte(proc_id);
+    }
+
+    OpenFile *file = findOpenFile(proc_id);
+    if (file == NULL) {
+        Serial.println(F("Error: no file opened."));
+        return false;
+    }
+    if (isReadOnly(file->addr)) {
+        Serial.println(F("Error: the file is read-only."));
+        return false;
+    }
+    if (type == STRING || type == STRING_REF) 
+        size--;
+    for (uint8_t i = 0; i < size; i++) {
+        if (!writeByte(file, (offset < 0) ? bytes[i] : readProgramByte(offset + i, proc_id)))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Read a value from the open file of a process and push it on the stack.
+ * 
+ * @param instruction READCHAR, READINT, READFLOAT or READSTRING.
+ * @param proc_id the process id of the process.
+ * @return true when the value is pushed, false when no file is open.
+ */
+bool readFile(uint8_t instruction, int proc_id)
+{
+    OpenFile *file = findOpenFile(proc_id);
+    if (file == NULL) {
+        Serial.println(F("Error: no file opened."));
+        return false;
+    }
+
+    switch (instruction) {
+        case READCHAR:
+            pushByte(readByte(file), proc_id);
+            pushByte(CHAR, proc_id);
+            break;
+        case READINT:
+            for (uint8_t i = 0; i < INT; i++) {
+                pushByte(readByte(file), proc_id);
+            }
+            pushByte(INT, proc_id);
+            break;
+        case READFLOAT:
+            for (uint8_t i = 0; i < FLOAT; i++) {
+                pushByte(readByte(file), proc_id);
+            }
+            pushByte(FLOAT, proc_id);
+            break;
+        case READSTRING:
+            // read up to a null char or the end of the file
+            uint8_t length = 0;
+            while (file->pos < file->size) {
+                uint8_t c = readByte(file);
+                if (c == '\0')
+                    break;
+                pushByte(c, proc_id);
+                length++;
+            }
+            pushByte('\0', proc_id);
+            pushByte(length + 1, proc_id);
+            pushByte(STRING, proc_id);
+            break;
+    }
+    return true;
+}
+
+/**
+ * Check if the data of a file is opened by a process.
+ * 
+ * @param addr begin address of the file data.
+ * @return true when a process has the file opened.
+ */
+bool checkOpen(int addr)
+{
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (open_files[i].proc_id != 0 && open_files[i].addr == addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Check if a process has a file opened.
+ * 
+ * @param proc_id the id of the process.
+ * @return true when the process has a file opened.
+ */
+bool hasOpenFile(int proc_id)
+{
+    return findOpenFile(proc_id) != NULL;
+}
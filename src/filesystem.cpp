@@ -27,194 +27,1104 @@
 #include "common.h"
 #include "filesystem.h"
 #include "cli.h"
+#include "processes.h"
+#include "fileio.h"
 
-EERef no_of_files = EEPROM[NOF_PTR];
+// FAT mirrored in RAM, entries beyond `no_of_files` are unused
+static int no_of_files = 0;
+static File fat[AMOUNT_OF_FILES];
+// hash of the name of every FAT entry, compared before the full name
+static uint8_t fat_hash[AMOUNT_OF_FILES];
+// bit for every FAT entry that changed in RAM, but not on the EEPROM
+static uint8_t fat_dirty[(AMOUNT_OF_FILES + 7) / 8];
+// false when the format of the filesystem is unknown, nothing is written to the EEPROM then
+static bool mounted = false;
+// free extents between the file data ordered on address, only kept in RAM
+static Extent free_map[AMOUNT_OF_FILES + 1];
+static int no_of_extents = 0;
+// amount of bytes actually written to the EEPROM since boot
+static unsigned long eeprom_writes = 0;
+// address where the search for space for the next file starts
+static int write_head = 0;
+// file data that is being moved by defrag
+static Move move = {-1, 0, 0};
+static bool defragging = false;
+// slot and sequence number of the last journal record
+static uint8_t journal_slot = JOURNAL_SLOTS - 1;
+static uint8_t journal_sequence = 0;
+// write counters of the regions, saved to the EEPROM every WEAR_SAVE_INTERVAL counted writes
+static uint16_t wear_counters[MAX_REGIONS];
+static uint8_t unsaved_writes = 0;
+// regions in which file data changed since the last counted write, one bit for every region
+static uint32_t changed_regions = 0;
 
-// Initialize `no_of_files` to zero if EEPROM empty, otherwise use existing value on EEPROM.
+/**
+ * Write a byte to the EEPROM, only when it differs from the byte already there.
+ * Every write to the EEPROM should go through this function.
+ * 
+ * @param addr address on the EEPROM.
+ * @param b the byte to write.
+ * @return true when the byte was written.
+ */
+static bool updateByte(int addr, uint8_t b)
+{
+    if (!mounted || EEPROM.read(addr) == b)
+        return false;
+    EEPROM.write(addr, b);
+    eeprom_writes++;
+    return true;
+}
+
+// Write a block of bytes to the EEPROM, only the bytes that differ are written.
+static void updateBlock(int addr, const void *data, int size)
+{
+    const uint8_t *bytes = (const uint8_t*)data;
+    for (int i = 0; i < size; i++) {
+        updateByte(addr + i, bytes[i]);
+    }
+}
+
+// Write a byte of file data, the region is counted by countWrite() when the byte changed.
+static void updateDataByte(int addr, uint8_t b)
+{
+    if (updateByte(addr, b))
+        changed_regions |= 1UL << (addr / REGION_SIZE);
+}
+
+// Write a block of file data, only the bytes that differ are written.
+static void updateDataBlock(int addr, const uint8_t *data, int size)
+{
+    for (int i = 0; i < size; i++) {
+        updateDataByte(addr + i, data[i]);
+    }
+}
+
+// Address of the FAT entry at index `e` on the EEPROM.
+static int entryAddress(int e)
+{
+    return FST_PTR + (e * sizeof(File));
+}
+
+// Amount of wear regions on the EEPROM.
+static int noOfRegions()
+{
+    return EEPROM.length() / REGION_SIZE;
+}
+
+// End of the data area, the config, the journal, the defrag move record and the wear counters are stored after it.
+static int dataEnd()
+{
+    return EEPROM.length() - (noOfRegions() * sizeof(uint16_t)) - sizeof(Move) - (JOURNAL_SLOTS * sizeof(Journal))
+        - sizeof(Config);
+}
+
+// Address of the config block.
+static int configAddress()
+{
+    return dataEnd();
+}
+
+// Address of a slot of the FAT journal.
+static int journalAddress(uint8_t slot)
+{
+    return configAddress() + sizeof(Config) + (slot * sizeof(Journal));
+}
+
+// Address of the defrag move record.
+static int moveAddress()
+{
+    return journalAddress(JOURNAL_SLOTS);
+}
+
+// Address of the wear counter of a region.
+static int wearCounterAddress(int region)
+{
+    return moveAddress() + sizeof(Move) + (region * sizeof(uint16_t));
+}
+
+// Read the wear counters of all regions into RAM, an erased counter is 0.
+static void loadWearCounters()
+{
+    for (int region = 0; region < noOfRegions(); region++) {
+        EEPROM.get(wearCounterAddress(region), wear_counters[region]);
+        if (wear_counters[region] == 0xFFFF) 
+            wear_counters[region] = 0;
+    }
+}
+
+// Save the wear counters that changed to the EEPROM.
+static void saveWearCounters()
+{
+    for (int region = 0; region < noOfRegions(); region++) {
+        updateBlock(wearCounterAddress(region), &wear_counters[region], sizeof(uint16_t));
+    }
+    unsaved_writes = 0;
+}
+
+/**
+ * Count a write of file data for every region in which a byte changed since the previous count. The
+ * counters are only saved every WEAR_SAVE_INTERVAL writes, otherwise they would be written more often
+ * than the data they count. Writes since the last save are lost on a reset.
+ */
+static void countWrite()
+{
+    for (int region = 0; region < noOfRegions(); region++) {
+        if (!(changed_regions & (1UL << region)))
+            continue;
+        wear_counters[region]++;
+        if (++unsaved_writes >= WEAR_SAVE_INTERVAL) 
+            saveWearCounters();
+    }
+    changed_regions = 0;
+}
+
+// Begin of the data area: the FAT entries in use and room for FAT_RESERVE more entries.
+static int dataStart()
+{
+    return entryAddress(no_of_files + FAT_RESERVE);
+}
+
+// Mark a FAT entry to be written back to the EEPROM.
+static void markDirty(int e)
+{
+    fat_dirty[e / 8] |= (1 << (e % 8));
+}
+
+// One byte hash of a filename.
+static uint8_t nameHash(const char *name)
+{
+    uint8_t hash = 0;
+    while (*name) {
+        hash = (hash << 1) + (hash >> 7) + *name++;
+    }
+    return hash;
+}
+
+// Add a byte to a CRC-16 (CCITT).
+static uint16_t crcUpdate(uint16_t crc, uint8_t b)
+{
+    crc ^= (uint16_t)b << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+// CRC-16 of a block of bytes in RAM.
+static uint16_t blockCRC(const void *data, int size)
+{
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < size; i++) {
+        crc = crcUpdate(crc, bytes[i]);
+    }
+    return crc;
+}
+
+// CRC-16 of file data on the EEPROM.
+static uint16_t dataCRC(int addr, int size)
+{
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < size; i++) {
+        crc = crcUpdate(crc, EEPROM.read(addr + i));
+    }
+    return crc;
+}
+
+// Write a journal record to the FAT on the EEPROM.
+static void applyJournal(const Journal *journal)
+{
+    if (journal->index != NO_ENTRY) 
+        updateBlock(entryAddress(journal->index), &journal->entry, sizeof(File));
+    updateByte(NOF_PTR, journal->no_of_files);
+}
+
+// Check if a journal record was written completely.
+static bool journalValid(const Journal *journal)
+{
+    return journal->crc == blockCRC(journal, offsetof(Journal, crc)) 
+        && (journal->index == NO_ENTRY || journal->index < AMOUNT_OF_FILES);
+}
+
+// Check if the change of a journal record is on the FAT on the EEPROM.
+static bool journalApplied(const Journal *journal)
+{
+    if (journal->index != NO_ENTRY) {
+        const uint8_t *bytes = (const uint8_t*)&journal->entry;
+        for (uint8_t i = 0; i < sizeof(File); i++) {
+            if (EEPROM.read(entryAddress(journal->index) + i) != bytes[i])
+                return false;
+        }
+    }
+    return EEPROM.read(NOF_PTR) == journal->no_of_files;
+}
+
+/**
+ * Write a change of the FAT through the journal. The change is complete once its record is written:
+ * a reset before that leaves the FAT as it was, after that the change is finished at boot. The record
+ * goes to the next slot, the previous records were applied already.
+ * 
+ * @param e index of the changed FAT entry, or NO_ENTRY when only the number of files changed.
+ */
+static void commitFAT(uint8_t e)
+{
+    Journal journal;
+    memset(&journal, 0, sizeof(Journal));
+    if (e != NO_ENTRY) 
+        journal.entry = fat[e];
+    journal.index = e;
+    journal.no_of_files = no_of_files;
+    journal.sequence = journal_sequence + 1;
+    journal.crc = blockCRC(&journal, offsetof(Journal, crc));
+
+    journal_slot = (journal_slot + 1) % JOURNAL_SLOTS;
+    journal_sequence = journal.sequence;
+    updateBlock(journalAddress(journal_slot), &journal, sizeof(Journal));
+    applyJournal(&journal);
+}
+
+// Finish a change of the FAT that was interrupted by a reset. Only the last complete record can be unfinished.
+static void replayJournal()
+{
+    Journal last;
+    bool found = false;
+    for (uint8_t slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        Journal journal;
+        EEPROM.get(journalAddress(slot), journal);
+        // sequence numbers wrap around, the slots are never more than JOURNAL_SLOTS apart
+        if (!journalValid(&journal) || (found && (int8_t)(journal.sequence - last.sequence) < 0))
+            continue;
+        last = journal;
+        journal_slot = slot;
+        journal_sequence = journal.sequence;
+        found = true;
+    }
+
+    if (found && !journalApplied(&last)) {
+        applyJournal(&last);
+        Serial.println(F("Finished an interrupted change of the FAT."));
+    }
+}
+
+// Write the FAT entries that changed in RAM and the number of files back to the EEPROM, through the journal.
+static void flushFAT()
+{
+    bool flushed = false;
+    for (int e = 0; e < AMOUNT_OF_FILES; e++) {
+        if (fat_dirty[e / 8] & (1 << (e % 8))) {
+            commitFAT(e);
+            flushed = true;
+        }
+    }
+    if (!flushed && EEPROM.read(NOF_PTR) != no_of_files) 
+        commitFAT(NO_ENTRY);
+    memset(fat_dirty, 0, sizeof(fat_dirty));
+}
+
+// Update the CRC in a FAT entry after its data changed.
+static void updateCRC(int e)
+{
+    uint16_t crc = dataCRC(fat[e].addr, fat[e].size);
+    if (crc == fat[e].crc)
+        return;
+    fat[e].crc = crc;
+    markDirty(e);
+    flushFAT();
+}
+
+/**
+ * Find a free extent with a binary search.
+ * 
+ * @param addr address on the EEPROM.
+ * @return index of the first free extent that ends after `addr`, or `no_of_extents` when there is none.
+ */
+static int findExtent(int addr)
+{
+    int low = 0;
+    int high = no_of_extents;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (free_map[mid].addr + free_map[mid].size <= addr) 
+            low = mid + 1;
+        else 
+            high = mid;
+    }
+    return low;
+}
+
+// Remove the space used by file data from the free extent it is in.
+static void reserveExtent(int addr, int size)
+{
+    int i = findExtent(addr);
+    Extent *extent = &free_map[i];
+    // overlapping file data is ignored
+    if (i == no_of_extents || extent->addr > addr || extent->addr + extent->size < addr + size)
+        return;
+
+    int before = addr - extent->addr;
+    int after = (extent->addr + extent->size) - (addr + size);
+    if (before > 0 && after > 0) {
+        // split the extent in two
+        memmove(free_map + i + 2, free_map + i + 1, (no_of_extents - i - 1) * sizeof(Extent));
+        no_of_extents++;
+        extent->size = before;
+        free_map[i + 1].addr = addr + size;
+        free_map[i + 1].size = after;
+    }
+    else if (before > 0) {
+        extent->size = before;
+    }
+    else if (after > 0) {
+        extent->addr = addr + size;
+        extent->size = after;
+    }
+    else {
+        memmove(free_map + i, free_map + i + 1, (--no_of_extents - i) * sizeof(Extent));
+    }
+}
+
+// Give the space of file data back, merged with the free extents next to it.
+static void releaseExtent(int addr, int size)
+{
+    int i = findExtent(addr);
+    bool merge_prev = i > 0 && free_map[i - 1].addr + free_map[i - 1].size == addr;
+    bool merge_next = i < no_of_extents && free_map[i].addr == addr + size;
+
+    if (merge_prev && merge_next) {
+        free_map[i - 1].size += size + free_map[i].size;
+        memmove(free_map + i, free_map + i + 1, (--no_of_extents - i) * sizeof(Extent));
+    }
+    else if (merge_prev) {
+        free_map[i - 1].size += size;
+    }
+    else if (merge_next) {
+        free_map[i].addr = addr;
+        free_map[i].size += size;
+    }
+    else {
+        memmove(free_map + i + 1, free_map + i, (no_of_extents++ - i) * sizeof(Extent));
+        free_map[i].addr = addr;
+        free_map[i].size = size;
+    }
+}
+
+// Begin of the usable part of a free extent, the FAT can grow into the first extent.
+static int extentStart(int i)
+{
+    return max(free_map[i].addr, dataStart());
+}
+
+// Size of the usable part of a free extent, zero or negative when the FAT covers it.
+static int extentSize(int i)
+{
+    return free_map[i].addr + free_map[i].size - extentStart(i);
+}
+
+// Index of the FAT entry of which the data begins at `addr`, or -1 when there is none.
+static int findEntryAt(int addr)
+{
+    for (int e = 0; e < no_of_files; e++) {
+        if (fat[e].addr == addr) {
+            return e;
+        }
+    }
+    return -1;
+}
+
+// Size of the part of the new place of the moved data, that was free before the move.
+static int moveLength(int size)
+{
+    return min(size, move.from - move.to);
+}
+
+/**
+ * Write the begin address of the moved data to the move record. A torn write always leaves a negative
+ * value: a new address is written from the low byte, clearing the record starts at the sign byte.
+ */
+static void saveMoveFrom()
+{
+    const uint8_t *bytes = (const uint8_t*)&move.from;
+    for (int n = 0; n < (int)sizeof(int); n++) {
+        int i = (move.from < 0) ? (sizeof(int) - 1 - n) : n;
+        updateByte(moveAddress() + i, bytes[i]);
+    }
+}
+
+// Point a FAT entry to the new place of the moved data and clear the move record.
+static void finishMove(int e)
+{
+    int length = moveLength(fat[e].size);
+    int from = move.from;
+    fat[e].addr = move.to;
+    markDirty(e);
+    flushFAT();
+    move.from = -1;
+    saveMoveFrom();
+    releaseExtent(from + fat[e].size - length, length);
+}
+
+/**
+ * Resume moving data that was interrupted by a reset. The data is copied from low to high addresses
+ * and the new place is never higher than the old place, so only source bytes that were copied already
+ * can be overwritten. Resuming at the last saved chunk is safe, because a chunk is not larger than the
+ * distance of the move.
+ */
+static void recoverMove()
+{
+    EEPROM.get(moveAddress(), move);
+    if (move.from < 0)
+        return;
+
+    if (findEntryAt(move.from) >= 0 && move.to < move.from) {
+        defragging = true;
+        Serial.println(F("Resuming interrupted defragmentation."));
+        return;
+    }
+
+    // the FAT entry already points to the new place, the journal makes sure it is not written partly
+    move.from = -1;
+    saveMoveFrom();
+}
+
+// Remove a FAT entry, the last entry is moved into the free slot so only one entry is rewritten.
+static void removeEntry(int e)
+{
+    if (e != no_of_files - 1) {
+        fat[e] = fat[no_of_files - 1];
+        fat_hash[e] = fat_hash[no_of_files - 1];
+        markDirty(e);
+    }
+
+    // entries beyond the number of files are unused, the last one doesn't need to be wiped
+    no_of_files--;
+    flushFAT();
+}
+
+/**
+ * Check the files after a reset. The name has to be terminated, the data has to be behind the FAT and match
+ * its CRC. A file that fails the check was being stored or written when the reset happened, it is removed.
+ * A file that was open for writing keeps the data that was written, its CRC is computed again.
+ */
+static void checkFiles()
+{
+    int e = 0;
+    while (e < no_of_files) {
+        File *file = &fat[e];
+        // data that is being moved by defrag is only complete at the old place when the move is done
+        if (checkMoving(file->addr) || (memchr(file->name, '\0', FILENAME_SIZE) != NULL && file->size > 0
+                && file->addr >= entryAddress(no_of_files) && file->addr + file->size <= dataEnd()
+                && (file->crc == CRC_UNCHECKED || dataCRC(file->addr, file->size) == file->crc))) {
+            e++;
+            continue;
+        }
+
+        file->name[FILENAME_SIZE - 1] = '\0';
+        Serial.print(F("Error: file \""));
+        Serial.print(file->name);
+        Serial.println(F("\" is damaged, it is removed from the filesystem."));
+        removeEntry(e);
+    }
+}
+
+/**
+ * Convert the FAT entries of a filesystem of the first version, from the last entry to the first. A new
+ * entry is larger than an old one and never overwrites old entries before it, but it overwrites its own
+ * old entry. So every entry is saved in the conversion record before it is written, and after a reset
+ * the last saved entry is written again. The files get their CRC at boot.
+ * 
+ * @return false when the conversion record is damaged.
+ */
+static bool convertEntries()
+{
+    Conversion conversion;
+    EEPROM.get(journalAddress(0), conversion);
+    if (conversion.no_of_files > OLD_AMOUNT_OF_FILES || conversion.done > conversion.no_of_files) {
+        Serial.println(F("Error: the conversion of the filesystem can not be resumed."));
+        return false;
+    }
+
+    int e = conversion.done;
+    if (e < conversion.no_of_files) 
+        updateBlock(entryAddress(e), &conversion.entries[e % 2], sizeof(File));
+
+    while (--e >= 0) {
+        int addr = OLD_FST_PTR + (e * OLD_ENTRY_SIZE);
+        File file;
+        memset(&file, 0, sizeof(File));
+        for (uint8_t i = 0; i < FILENAME_SIZE - 1; i++) {
+            file.name[i] = EEPROM.read(addr + i);
+        }
+        file.addr = EEPROM.read(addr + FILENAME_SIZE) | (EEPROM.read(addr + FILENAME_SIZE + 1) << 8);
+        file.size = EEPROM.read(addr + FILENAME_SIZE + 2) | (EEPROM.read(addr + FILENAME_SIZE + 3) << 8);
+        file.crc = CRC_UNCHECKED;
+
+        int saved = journalAddress(0) + offsetof(Conversion, entries) + ((e % 2) * sizeof(File));
+        updateBlock(saved, &file, sizeof(File));
+        updateByte(journalAddress(0) + offsetof(Conversion, done), e);
+        updateBlock(entryAddress(e), &file, sizeof(File));
+    }
+
+    updateByte(NOF_PTR, conversion.no_of_files);
+    updateByte(FORMAT_PTR, FS_FORMAT);
+    // a journal slot that is written partly doesn't match its CRC, so the record can be wiped after the format byte
+    for (uint8_t i = 0; i < sizeof(Conversion); i++) {
+        updateByte(journalAddress(0) + i, 0xFF);
+    }
+    Serial.println(F("Converted the filesystem to the new format."));
+    return true;
+}
+
+/**
+ * Start the conversion of a filesystem of the first version. Its files are only converted when their data
+ * is behind the new FAT and before the config block, the bytes after the data area are wiped for the new
+ * records.
+ * 
+ * @param count number of files in the old FAT.
+ * @return false when the files are in the way of the new FAT or the records after the data area.
+ */
+static bool startConversion(uint8_t count)
+{
+    for (int e = 0; e < count; e++) {
+        int addr = OLD_FST_PTR + (e * OLD_ENTRY_SIZE) + FILENAME_SIZE;
+        int data = EEPROM.read(addr) | (EEPROM.read(addr + 1) << 8);
+        int size = EEPROM.read(addr + 2) | (EEPROM.read(addr + 3) << 8);
+        if (data < entryAddress(count) || size <= 0 || data + size > dataEnd()) {
+            Serial.println(F("Error: the files of the old filesystem are in the way of the new format."));
+            return false;
+        }
+    }
+
+    for (int addr = dataEnd(); addr < EEPROM.length(); addr++) {
+        updateByte(addr, 0xFF);
+    }
+    Conversion conversion;
+    memset(&conversion, 0xFF, sizeof(Conversion));
+    conversion.no_of_files = count;
+    conversion.done = count;
+    updateBlock(journalAddress(0), &conversion, sizeof(Conversion));
+    updateByte(FORMAT_PTR, FS_CONVERTING);
+    return true;
+}
+
+/**
+ * Check the format byte of the filesystem. An erased EEPROM gets a new filesystem and a filesystem of
+ * the first version is converted. A filesystem of an unknown format is not mounted, so its data is kept.
+ * 
+ * @return true when the filesystem is mounted.
+ */
+static bool mountFileSystem()
+{
+    uint8_t format = EEPROM.read(FORMAT_PTR);
+    mounted = true;
+    if (format == 0xFF) {
+        updateByte(NOF_PTR, 0);
+        updateByte(FORMAT_PTR, FS_FORMAT);
+    }
+    else if (format <= OLD_AMOUNT_OF_FILES) {
+        mounted = startConversion(format) && convertEntries();
+    }
+    else if (format == FS_CONVERTING) {
+        mounted = convertEntries();
+    }
+    else if (format != FS_FORMAT) {
+        Serial.println(F("Error: unknown filesystem format."));
+        mounted = false;
+    }
+    return mounted;
+}
+
+// Mount the filesystem, a new EEPROM is formatted and an older format is converted first.
+// The FAT is read into RAM once, all lookups are done on this copy. The FAT only takes the
+// space of the files in it, the bytes after the last entry belong to the data area.
+// A FAT change that was interrupted by a reset is finished first, then every file is checked.
 void initFileSystem() 
 {
-    if (EEPROM.read(NOF_PTR) == 0xFF) {
-        no_of_files = 0;
+    no_of_files = 0;
+    no_of_extents = 0;
+    if (!mountFileSystem()) {
+        Serial.println(F("The filesystem is not mounted, erase the EEPROM to start a new filesystem."));
+        return;
+    }
+
+    loadWearCounters();
+    replayJournal();
+    no_of_files = EEPROM.read(NOF_PTR);
+    if (no_of_files > AMOUNT_OF_FILES) {
+        Serial.println(F("Error: too many files in the filesystem, only the first files are used."));
+        no_of_files = AMOUNT_OF_FILES;
+    }
+
+    for (int e = 0; e < no_of_files; e++) {
+        EEPROM.get(entryAddress(e), fat[e]);
+        fat_hash[e] = nameHash(fat[e].name);
+    }
+
+    recoverMove();
+    checkFiles();
+    for (int e = 0; e < no_of_files; e++) {
+        if (fat[e].crc == CRC_UNCHECKED)
+            updateCRC(e);
+    }
+
+    // build the free extents, and continue writing after the file with the highest address
+    no_of_extents = 1;
+    free_map[0].addr = FST_PTR;
+    free_map[0].size = dataEnd() - FST_PTR;
+    for (int e = 0; e < no_of_files; e++) {
+        reserveExtent(fat[e].addr, fat[e].size);
+        write_head = max(write_head, fat[e].addr + fat[e].size);
     }
+    if (move.from >= 0) 
+        reserveExtent(move.to, moveLength(fat[findEntryAt(move.from)].size));
 }
 
 /**
- * Store a file in the ArduinOS filesystem.
+ * Find a file in the FAT by name.
  * 
  * @param name name of the file.
- * @return begin address pointer of the FAT entry.
+ * @return begin address pointer of the FAT entry, or -1 when the file doesn't exist.
  */
 int findFATEntry(const char *name) 
 {
-    // find an entry on the EEPROM by name.
-    // returns: address pointer of the FAT entry.
-    if (no_of_files == 0) return -1;
-
-    int eof_last_file_ptr = FST_PTR + ((int)no_of_files * sizeof(File));
-    // compare the name of every file struct to the arg
-    for (int e = FST_PTR; e < eof_last_file_ptr; e += sizeof(File)) {
-        File file = (File)EEPROM.get(e, file);
-        if (strcmp(file.name, name) == 0) {
-            return e;
+    // compare the name of every file struct to the arg, when the hash matches
+    uint8_t hash = nameHash(name);
+    for (int e = 0; e < no_of_files; e++) {
+        if (fat_hash[e] == hash && strcmp(fat[e].name, name) == 0) {
+            return entryAddress(e);
+        }
+    }
+    // files on the read-only volume
+    for (int e = 0; e < no_of_rom_files; e++) {
+        if (strcmp_P(name, rom_files[e].name) == 0) {
+            return ROM_FST_PTR + (e * sizeof(File));
         }
     }
     return -1;
 }
 
 /**
- * Read a FAT entry from the EEPROM.
+ * Read a FAT entry.
  * 
- * @param addr begin address pointer of the FAT entry on the EEPROM.
+ * @param addr begin address pointer of the FAT entry on the EEPROM or the read-only volume.
  * @return File struct representing a FAT entry.
  */
 File readFATEntry(int addr)
 {
-    File file = EEPROM.get(addr, file);
-    return file;
+    if (isReadOnly(addr)) {
+        File file;
+        memcpy_P(&file, &rom_files[(addr - ROM_FST_PTR) / sizeof(File)], sizeof(File));
+        return file;
+    }
+    return fat[(addr - FST_PTR) / sizeof(File)];
+}
+
+/**
+ * Check if an address is on the read-only volume in program memory.
+ * 
+ * @param addr address of a FAT entry or of file data.
+ * @return true for addresses on the read-only volume, false for the EEPROM.
+ */
+bool isReadOnly(int addr)
+{
+    return addr >= ROM_FST_PTR;
 }
 
 /**
- * Read one byte of data from the EEPROM at the program counter.
+ * Read one byte of data at the program counter, from the volume the address belongs to.
  * 
  * @param pc program counter of a process.
  * @return one byte (uint8_t) of data at the pc location.
  */
 uint8_t readPcByte(int pc)
 {
+    if (isReadOnly(pc)) 
+        return pgm_read_byte(&rom_data[pc - ROM_DATA_PTR]);
     return EEPROM.read(pc);
 }
 
-// Write a file to the EEPROM.
-static void writeFATEntry(File file) 
+/**
+ * Check if the data of a file is compressed.
+ * 
+ * @param file the FAT entry of the file.
+ * @return true when the file is marked as compressed in its FAT entry.
+ */
+bool isCompressed(File file)
 {
-    EEPROM.put(FST_PTR + ((int)no_of_files * sizeof(File)), file);
-    // update number of files in EEPROM
-    no_of_files++;
+    return file.flags & FILE_COMPRESSED;
 }
 
-// Write data to the referenced address in the FAT.
-static void writeData(int addr, int size, char *data) 
+/**
+ * Get the size of the data of a file, after decompression.
+ * 
+ * @param file the FAT entry of the file.
+ * @return size of the original data.
+ */
+int dataSize(File file)
 {
-    int str_index = 0;
-    for (int b = addr; b < (addr + size); b++) {
-        EEPROM.write(b, data[str_index]);
-        str_index++;
-    }
+    if (!isCompressed(file))
+        return file.size;
+    return (readPcByte(file.addr) << 8) | readPcByte(file.addr + 1);
 }
 
-// Sort the FAT based on the address of the filedata.
-static void sortFAT() 
+/**
+ * Decompress the data of a file. Back references only reach the last LZ_WINDOW bytes, so printing the
+ * data only needs a window of that size instead of a buffer for the whole file.
+ * 
+ * @param file the FAT entry of a compressed file.
+ * @param data buffer of dataSize() bytes for the original data, or NULL to print the data.
+ */
+static void decompress(File file, uint8_t *data)
 {
-    int eof_last_file_ptr = FST_PTR + ((int)no_of_files * sizeof(File));
-    // compare current file with next file
-    for (int c = FST_PTR; c < eof_last_file_ptr; c += sizeof(File)) {
-        for (int n = c + sizeof(File); n < eof_last_file_ptr; n += sizeof(File)) {
-            File c_file = (File)EEPROM.get(c, c_file);
-            File n_file = (File)EEPROM.get(n, n_file);
+    uint8_t window[LZ_WINDOW];
+    int size = dataSize(file);
+    int end = file.addr + file.size;
+    int addr = file.addr + LZ_HEADER;
+    int n = 0;
+    uint8_t flags = 0;
+    uint8_t items = 0;
 
-            if (c_file.addr > n_file.addr) {
-                File temp = c_file;
-                EEPROM.put(c, n_file);
-                EEPROM.put(n, temp);
-            }
+    while (n < size && addr < end) {
+        if (items == 0) {
+            flags = readPcByte(addr++);
+            items = 8;
+            continue;
+        }
+
+        int length = 1;
+        int distance = 0;
+        uint8_t b = readPcByte(addr++);
+        if (flags & 1) {
+            length = (b >> 5) + LZ_MIN_LENGTH;
+            distance = (b & (LZ_WINDOW - 1)) + 1;
+            // a reference before the begin of the data means the file is damaged
+            if (distance > n) 
+                break;
+        }
+        flags >>= 1;
+        items--;
+
+        for (int i = 0; i < length && n < size; i++, n++) {
+            if (distance > 0) 
+                b = window[(n - distance) & (LZ_WINDOW - 1)];
+            window[n & (LZ_WINDOW - 1)] = b;
+            if (data != NULL) 
+                data[n] = b;
+            // 255 means empty in the EEPROM, also empty character in ASCII table
+            else if (b != 0xFF) 
+                Serial.print((char)b);
         }
-    }    
+    }
+}
+
+/**
+ * Copy the data of a file to RAM, compressed files are decompressed.
+ * 
+ * @param file the FAT entry of the file.
+ * @param data buffer of dataSize() bytes.
+ */
+void readFileData(File file, uint8_t *data)
+{
+    if (isCompressed(file)) {
+        decompress(file, data);
+        return;
+    }
+    for (int i = 0; i < file.size; i++) {
+        data[i] = readPcByte(file.addr + i);
+    }
+}
+
+// Add a file to the FAT.
+static void writeFATEntry(File file) 
+{
+    fat[no_of_files] = file;
+    fat_hash[no_of_files] = nameHash(file.name);
+    reserveExtent(file.addr, file.size);
+    markDirty(no_of_files);
+    // update number of files
+    no_of_files++;
+    flushFAT();
+}
+
+// Write data to the referenced address in the FAT.
+static void writeData(int addr, int size, const uint8_t *data) 
+{
+    updateDataBlock(addr, data, size);
+    countWrite();
+    write_head = addr + size;
 }
 
 /**
- * Check the available space in the filesystem.
+ * Check the available space in the filesystem. The free space is picked according to `FIT_POLICY`.
+ * With next fit storing continues after the previously stored file, wrapping around to the begin of
+ * the data area. Rewriting the same file therefore moves it through all free space, instead of wearing
+ * out the first hole after the FAT.
  * 
  * @param size size of the file that needs to be allocated.
- * @return begin pointer on the EEPROM where the file can be written when `size` is a positive integer, 
- *      or the max size that can be used by files in the filesystem when `size` is a negetive integer.
+ * @return begin pointer on the EEPROM where the file can be written, or -1 for errors.
  */
 static int checkFileSystemSpace(int size) 
 {
-    int max_free_space = 0;
-
+    if (!mounted) {
+        Serial.println(F("Error: the filesystem is not mounted."));
+        return -1;
+    }
     // first check if we need to check at all
-    if ((int)no_of_files == AMOUNT_OF_FILES) {
-        if (size < 0) return max_free_space;
+    if (no_of_files == AMOUNT_OF_FILES) {
         Serial.println(F("Error: file limit reached."));
         return -1;
     }
 
-    // calculate end of FAT pointer based on amount of files
-    int eof_address = FST_PTR + (AMOUNT_OF_FILES * sizeof(File));
-
     // the amount of space for data is limited
-    if ((int)no_of_files == 0) {
-        if (size < 0) {
-            return (int)EEPROM.length() - eof_address;
+    int data_size = dataEnd() - dataStart();
+    if (size > data_size) {
+        Serial.print(F("Error: cannot save a file with size: "));
+        Serial.print(size);
+        Serial.print(F("Max size is: "));
+        Serial.println(data_size);
+        return -1;
+    }
+
+    int found = -1;
+#if FIT_POLICY == NEXT_FIT
+    // the write head can be within a free extent
+    int i = findExtent(write_head);
+    if (i < no_of_extents && free_map[i].addr + free_map[i].size - max(write_head, extentStart(i)) >= size)
+        return max(write_head, extentStart(i));
+    for (int n = i + 1; n < no_of_extents; n++) {
+        if (extentSize(n) >= size)
+            return extentStart(n);
+    }
+    // wrap around
+    for (int n = 0; n <= i && n < no_of_extents; n++) {
+        if (extentSize(n) >= size) {
+            found = n;
+            break;
         }
-        else if (size > ((int)EEPROM.length() - eof_address)) {
-            Serial.print(F("Error: cannot save a file with size: "));
-            Serial.print(size);
-            Serial.print(F("Max size is: "));
-            Serial.println((int)EEPROM.length() - eof_address);
-            return -1;
+    }
+#else
+    for (int n = 0; n < no_of_extents; n++) {
+        if (extentSize(n) >= size && (found < 0 || extentSize(n) < extentSize(found))) {
+            found = n;
+            if (FIT_POLICY == FIRST_FIT || extentSize(n) == size)
+                break;
         }
-        else return eof_address;
     }
+#endif
+    if (found >= 0) 
+        return extentStart(found);
 
-    // sort FAT based on begin address
-    if ((int)no_of_files > 1) 
-        sortFAT();
+    Serial.println(F("Error: not enough space left in the filesystem."));
+    return -1;
+}
 
-    // check for free space between the first file & end of FAT
-    File first_file = (File)EEPROM.get(FST_PTR, first_file);
-    if (size < 0) max_free_space = first_file.addr - eof_address;
-    else if ((first_file.addr - eof_address) >= size) {
-        return eof_address;
+/**
+ * Make room for one more FAT entry. Files of which the data is in the way are moved to free space,
+ * the data is copied before the FAT entry points to the new address.
+ * 
+ * @return true when the FAT can grow, false when there is no space to move the data to.
+ */
+static bool growFAT()
+{
+    if (no_of_files == AMOUNT_OF_FILES)
+        return true;
+
+    // data that is being moved or executed can not be moved out of the way
+    if (move.from >= 0 && move.to < entryAddress(no_of_files + 1)) {
+        Serial.println(F("Error: the FAT can not grow while defrag moves data behind it."));
+        return false;
     }
 
-    int eof_last_file_ptr = FST_PTR + ((int)no_of_files * sizeof(File));
+    for (int e = 0; e < no_of_files; e++) {
+        if (fat[e].addr >= entryAddress(no_of_files + 1)) 
+            continue;
+        if (checkExecuting(fat[e].addr) || checkOpen(fat[e].addr)) {
+            Serial.println(F("Error: the FAT can not grow while a file behind it is in use."));
+            return false;
+        }
 
-    // look for free space between all the files
-    for (int a = FST_PTR; a < eof_last_file_ptr; a += sizeof(File)) {
-        File c_file = (File)EEPROM.get(a, c_file);
-        File n_file = (File)EEPROM.get((a + sizeof(File)), n_file);
+        int addr = checkFileSystemSpace(fat[e].size);
+        if (addr < 0)
+            return false;
 
-        if (size < 0) {
-            if ((n_file.addr - (c_file.addr + c_file.size)) > max_free_space) {
-                max_free_space = n_file.addr - (c_file.addr + c_file.size);
-            }
-            else continue;
-        }
-        else if ((n_file.addr - (c_file.addr + c_file.size)) >= size) {
-            return c_file.addr + c_file.size;
+        for (int i = 0; i < fat[e].size; i++) {
+            updateDataByte(addr + i, EEPROM.read(fat[e].addr + i));
         }
+        countWrite();
+        reserveExtent(addr, fat[e].size);
+        releaseExtent(fat[e].addr, fat[e].size);
+        fat[e].addr = addr;
+        markDirty(e);
+        flushFAT();
     }
-    
-    File last_file = EEPROM.get((eof_last_file_ptr - sizeof(File)), last_file);
-    int remaining_file_space = (int)EEPROM.length() - (last_file.addr + last_file.size);
-    // space till end of EEPROM
-    if (size < 0) {
-        if (remaining_file_space > max_free_space) {
-            max_free_space = remaining_file_space;
-        }
-        return max_free_space;
+    return true;
+}
+
+/**
+ * Create a file in the filesystem. The data is written before the FAT entry, a reset in between
+ * leaves the data in free space.
+ * 
+ * @param name name of the file.
+ * @param size size of the file.
+ * @param data the data of the file, or NULL to keep the bytes that are there now.
+ * @param flags FILE_COMPRESSED when the data is compressed, otherwise 0.
+ * @return begin address of the file data, or -1 when the file can not be created.
+ */
+int createFile(const char *name, int size, const uint8_t *data, uint8_t flags)
+{
+    if (strlen(name) >= FILENAME_SIZE) {
+        Serial.print(F("Error: the name of a file can be at most "));
+        Serial.print(FILENAME_SIZE - 1);
+        Serial.println(F(" characters."));
+        return -1;
     }
-    else if (remaining_file_space >= size) {
-        return last_file.addr + last_file.size;
+    // check if filename exists
+    if (findFATEntry(name) >= 0) {
+        Serial.print(F("Error: file with name \""));
+        Serial.print(name);
+        Serial.println(F("\" already exists in the filesystem."));
+        return -1;
+    }
+
+    // check for free space in the FAT & drive
+    if (!growFAT())
+        return -1;
+    int blk_ptr = checkFileSystemSpace(size);
+    if (blk_ptr < FST_PTR)
+        return -1;
+
+    File file = {0};
+    strcpy(file.name, name);
+    file.addr = blk_ptr;
+    file.size = size;
+    file.flags = flags;
+    if (data != NULL) 
+        writeData(blk_ptr, size, data);
+    file.crc = dataCRC(blk_ptr, size);
+    writeFATEntry(file);
+    return blk_ptr;
+}
+
+/**
+ * Remove a file from the filesystem. The file data is left as is, the space is free once the FAT entry is gone.
+ * 
+ * @param f_addr begin address pointer of the FAT entry.
+ * @return true when the file is removed, false when it is read-only or in use.
+ */
+bool removeFile(int f_addr)
+{
+    File file = readFATEntry(f_addr);
+    // a process that executes the program from the EEPROM would run whatever is written in its place
+    if (isReadOnly(f_addr) || checkMoving(file.addr) || checkOpen(file.addr) || checkExecuting(file.addr)) {
+        Serial.print(F("Error: file \""));
+        Serial.print(file.name);
+        if (isReadOnly(f_addr))
+            Serial.println(F("\" is read-only."));
+        else if (checkMoving(file.addr))
+            Serial.println(F("\" is being moved by defrag."));
+        else if (checkOpen(file.addr))
+            Serial.println(F("\" is opened by a process."));
+        else
+            Serial.println(F("\" is executed by a process."));
+        return false;
+    }
+    releaseExtent(file.addr, file.size);
+    removeEntry((f_addr - FST_PTR) / sizeof(File));
+    return true;
+}
+
+// Index of the FAT entry of which the data contains `addr`, or -1 when there is none.
+static int findEntryContaining(int addr)
+{
+    for (int e = 0; e < no_of_files; e++) {
+        if (addr >= fat[e].addr && addr < fat[e].addr + fat[e].size) {
+            return e;
+        }
     }
-   
-    Serial.println(F("Error: not enough space left in the filesystem."));
     return -1;
 }
 
 /**
- * Store a file in the ArduinOS filesystem.
+ * Write file data that was changed by a process, only the bytes that differ are written. Computing the CRC
+ * for every write would write the FAT entry and the journal every time, so the CRC of a file that stays
+ * open is only marked unchecked once, until updateFileCRC() is called.
+ * 
+ * @param addr address of the data on the EEPROM.
+ * @param data the data to write.
+ * @param size amount of bytes.
+ * @param update_crc compute the CRC right away, a reset during the write makes the file fail its check at boot.
+ */
+void updateFileData(int addr, const uint8_t *data, int size, bool update_crc)
+{
+    int e = findEntryContaining(addr);
+    bool changed = false;
+    for (int i = 0; i < size && !changed; i++) {
+        changed = EEPROM.read(addr + i) != data[i];
+    }
+    // the CRC is marked before the data changes, so a reset while writing doesn't make the file fail its check
+    if (changed && !update_crc && e >= 0 && fat[e].crc != CRC_UNCHECKED) {
+        fat[e].crc = CRC_UNCHECKED;
+        markDirty(e);
+        flushFAT();
+    }
+    if (changed) {
+        updateDataBlock(addr, data, size);
+        countWrite();
+    }
+    if (update_crc && e >= 0)
+        updateCRC(e);
+}
+
+/**
+ * Compute the CRC of a file again after a process wrote to it, the FAT entry is only written when it changed.
+ * 
+ * @param addr begin address of the file data.
+ */
+void updateFileCRC(int addr)
+{
+    int e = findEntryContaining(addr);
+    if (e >= 0)
+        updateCRC(e);
+}
+
+/**
+ * Read the settings from the config block on the EEPROM.
+ * 
+ * @return the settings, fields that were never written are 0xFF.
+ */
+Config readConfig()
+{
+    Config config;
+    // the console reads the config before the filesystem is mounted, other formats have no config block
+    if (EEPROM.read(FORMAT_PTR) == FS_FORMAT) 
+        EEPROM.get(configAddress(), config);
+    else 
+        memset(&config, 0xFF, sizeof(Config));
+    return config;
+}
+
+/**
+ * Write the settings to the config block on the EEPROM, only the bytes that differ are written.
+ * 
+ * @param config the settings.
+ */
+void writeConfig(Config config)
+{
+    if (!mounted) 
+        Serial.println(F("Error: the filesystem is not mounted, the setting is not saved."));
+    updateBlock(configAddress(), &config, sizeof(Config));
+}
+
+/**
+ * Store a file in the ArduinOS filesystem. When "z" is provided as third argument, the data is
+ * compressed and the file is marked as compressed.
  * 
  * @param argv CommandArgs struct with string arguments.
  */
 void store(CommandArgs argv) 
 {
-    for (int i = 0; i < MAX_ARG_AMOUNT; i++) {
-        if (strlen(argv.arg[i]) == 0) {
-            Serial.println(F("Error: Not enough arguments provided."));
-            return;
-        }
+    if (strlen(argv.arg[0]) == 0 || strlen(argv.arg[1]) == 0) {
+        Serial.println(F("Error: Not enough arguments provided."));
+        return;
     }
     // check that the size is a positive number
     int size = atoi(argv.arg[1]);
@@ -222,46 +1132,61 @@ void store(CommandArgs argv)
         Serial.println(F("Error: the \"size\" argument should be a postitive number."));
         return;
     }
+    uint8_t flags = (strcmp(argv.arg[2], "z") == 0) ? FILE_COMPRESSED : 0;
 
+    // the data is read first, so the file only appears in the FAT once all data is written
     char *name = strdup(argv.arg[0]);
-    // check if filename exists
-    if (findFATEntry(name) > 0) {
-        Serial.print(F("Error: file with name \""));
-        Serial.print(name);
-        Serial.println(F("\" already exists in the filesystem."));
-
+    uint8_t *data = (uint8_t*)malloc(size);
+    Serial.readBytes(data, size);
+    if ((flags & FILE_COMPRESSED) && size <= LZ_HEADER) {
+        Serial.println(F("Error: a compressed file starts with its original size."));
         free(name);
+        free(data);
         return;
     }
-
-    // check for free space in the FAT & drive
-    int blk_ptr = checkFileSystemSpace(size);
-    if (blk_ptr < FST_PTR) {
+    if (createFile(name, size, data, flags) < 0) {
         free(name);
+        free(data);
         return;
     }
 
-    // create a file in the filesystem
-    File file = {0};
-    strcpy(file.name, name);
-    file.addr = blk_ptr;
-    file.size = size;
-    writeFATEntry(file);
-
-    // write the file data to the drive
-    char *data = (char*)malloc(size);
-    Serial.readBytes(data, size);
-    writeData(blk_ptr, size, data);
-
     Serial.print(F("File \""));
-    Serial.print(file.name);
+    Serial.print(name);
     Serial.println(F("\" stored successfully."));
     free(name);
     free(data);
 }
 
+// Send a frame of binary retrieve, the data followed by its length and CRC.
+static void sendFrame(const uint8_t *data, uint8_t length, uint16_t crc)
+{
+    Serial.write(length);
+    Serial.write(data, length);
+    Serial.write((uint8_t)(crc >> 8));
+    Serial.write((uint8_t)(crc & 0xFF));
+}
+
+// Send the data of a file as it is stored, in frames with a CRC.
+static void sendBinary(File file)
+{
+    uint8_t chunk[RETRIEVE_CHUNK];
+    uint16_t file_crc = 0xFFFF;
+    for (int pos = 0; pos < file.size; pos += RETRIEVE_CHUNK) {
+        uint8_t length = min(RETRIEVE_CHUNK, file.size - pos);
+        uint16_t crc = 0xFFFF;
+        for (uint8_t i = 0; i < length; i++) {
+            chunk[i] = readPcByte(file.addr + pos + i);
+            crc = crcUpdate(crc, chunk[i]);
+            file_crc = crcUpdate(file_crc, chunk[i]);
+        }
+        sendFrame(chunk, length, crc);
+    }
+    sendFrame(chunk, 0, file_crc);
+}
+
 /**
- * Retrieve a file from the ArduinOS filesystem and print the data.
+ * Retrieve a file from the ArduinOS filesystem and print the data. When "binary" is provided as second
+ * argument, the data is sent as it is stored, in frames with a CRC.
  * 
  * @param argv CommandArgs struct with string arguments.
  */
@@ -287,15 +1212,32 @@ void retrieve(CommandArgs argv)
         return;
     }
 
+    File file = readFATEntry(f_addr);
+    if (strcmp(argv.arg[1], "binary") == 0) {
+        Serial.print(F("Binary file \""));
+        Serial.print(file_name);
+        Serial.print(F("\": "));
+        Serial.print(file.size);
+        Serial.println(F(" bytes."));
+        sendBinary(file);
+        free(file_name);
+        return;
+    }
+
     // print the data
-    File file = EEPROM.get(f_addr, file);
     Serial.print(F("Data in file \""));
     Serial.print(file_name);
     Serial.print(F("\": "));
-    for (int i = file.addr; i < (file.addr + file.size); i++) {
-        // 255 means empty in the EEPROM, also empty character in ASCII table
-        if ((int)EEPROM.read(i) != 0xFF) {
-            Serial.print((char)EEPROM.read(i));
+    if (isCompressed(file)) {
+        decompress(file, NULL);
+    }
+    else {
+        for (int i = file.addr; i < (file.addr + file.size); i++) {
+            // 255 means empty in the EEPROM, also empty character in ASCII table
+            uint8_t b = readPcByte(i);
+            if (b != 0xFF) {
+                Serial.print((char)b);
+            }
         }
     }
     Serial.println();
@@ -330,26 +1272,11 @@ void erase(CommandArgs argv)
         return;
     }
 
-    // remove the file data by writing original EEPROM values
-    File file = (File)EEPROM.get(f_addr, file);
-    for (int b = file.addr; b < (file.addr + file.size); b++) {
-        EEPROM.write(b, 0xFF);
-    }
-
-    int eof_last_file_ptr = FST_PTR + ((int)no_of_files * sizeof(File));
-    int last_file_ptr = FST_PTR + (((int)no_of_files - 1) * sizeof(File));
-    // move existing extries in the FAT
-    for (int a = f_addr; a < last_file_ptr; a += sizeof(File)) {
-        File n_file = (File)EEPROM.get((a + sizeof(File)), n_file);
-        EEPROM.put(a, n_file);
-    }
-
-    // remove the remaining entry by rewriting the original EEPROM values
-    for (int a = last_file_ptr; a < eof_last_file_ptr; a++) {
-        EEPROM.write(a, 0xFF);
+    File file = readFATEntry(f_addr);
+    if (!removeFile(f_addr)) {
+        free(file_name);
+        return;
     }
-    // update number of files in EEPROM
-    no_of_files--;
 
     Serial.print(F("File \""));
     Serial.print(file.name);
@@ -364,39 +1291,170 @@ void erase(CommandArgs argv)
  */
 void files(CommandArgs argv) 
 {
-    if ((int)no_of_files == 0) {
+    if (no_of_files == 0 && no_of_rom_files == 0) {
         Serial.println(F("No files in the filesystem."));
         return;
     }
-    int eof_last_file_ptr = FST_PTR + ((int)no_of_files * sizeof(File));
-    // loop through all the files in list the names.
-    for (int e = FST_PTR; e < eof_last_file_ptr; e += sizeof(File)) {
-        File file = (File)EEPROM.get(e, file);
+    // loop through all the files in list the names, the read-only files come last.
+    for (int e = 0; e < no_of_files + no_of_rom_files; e++) {
+        File file = (e < no_of_files) ? fat[e] : readFATEntry(ROM_FST_PTR + ((e - no_of_files) * sizeof(File)));
         Serial.print(file.name);
         Serial.print(F(", "));
-        Serial.print(file.size);
-        Serial.println(F(" bytes."));
+        Serial.print(dataSize(file));
+        if (isCompressed(file)) {
+            Serial.print(F(" bytes, compressed to "));
+            Serial.print(file.size);
+        }
+        Serial.print(F(" bytes"));
+        if (isReadOnly(file.addr))
+            Serial.print(F(", read-only"));
+        Serial.println(F("."));
     }
 }
 
 /**
- * Print the size of the largest available space in the ArduinOS filesystem.
+ * Print the total available space and the size of the largest available space in the ArduinOS filesystem.
  * 
  * @param argv CommandArgs struct with string arguments.
  */
 void freespace(CommandArgs argv) 
 {
+    int total = 0;
+    int largest = 0;
+    for (int i = 0; i < no_of_extents; i++) {
+        if (extentSize(i) > 0) {
+            total += extentSize(i);
+            largest = max(largest, extentSize(i));
+        }
+    }
+
     Serial.print(F("Free space available in filesystem: "));
-    Serial.print(checkFileSystemSpace(-1));
+    Serial.print(total);
     Serial.println(F(" bytes."));
+    Serial.print(F("Largest file that can be stored: "));
+    Serial.print(no_of_files == AMOUNT_OF_FILES ? 0 : largest);
+    Serial.println(F(" bytes."));
+    Serial.print(F("Bytes written to EEPROM since boot: "));
+    Serial.println(eeprom_writes);
+}
+
+/**
+ * Print the amount of data writes for every region of the EEPROM.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void wear(CommandArgs argv)
+{
+    for (int region = 0; region < noOfRegions(); region++) {
+        Serial.print(region * REGION_SIZE);
+        Serial.print(F(": "));
+        Serial.print(wear_counters[region]);
+        Serial.println(F(" writes."));
+    }
+    Serial.print(F("Next file is written at: "));
+    Serial.println(write_head);
+}
+
+/**
+ * Start moving the data of the first file that has free space before it. Files that are executed from
+ * the EEPROM or opened by a process are not moved.
+ * 
+ * @return true when a move is started, false when there is nothing left to move.
+ */
+static bool startMove()
+{
+    for (int i = 0; i < no_of_extents; i++) {
+        int e = findEntryAt(free_map[i].addr + free_map[i].size);
+        if (extentSize(i) <= 0 || e < 0 || checkExecuting(fat[e].addr) || checkOpen(fat[e].addr))
+            continue;
+
+        move.to = extentStart(i);
+        move.steps = 0;
+        updateBlock(moveAddress() + offsetof(Move, to), &move.to, sizeof(move.to));
+        updateBlock(moveAddress() + offsetof(Move, steps), &move.steps, sizeof(move.steps));
+        // a valid begin address marks the record as in use
+        move.from = fat[e].addr;
+        saveMoveFrom();
+        reserveExtent(move.to, moveLength(fat[e].size));
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Move the next chunk of the data that is being moved by defrag. Called from the main loop, so running
+ * processes keep running while the EEPROM is defragmented.
+ */
+void runDefrag()
+{
+    if (!defragging) 
+        return;
+
+    if (move.from < 0 && !startMove()) {
+        defragging = false;
+        saveWearCounters();
+        Serial.println(F("Defragmentation finished."));
+        return;
+    }
+
+    int e = findEntryAt(move.from);
+    int chunk = min(DEFRAG_STEP, move.from - move.to);
+    // decode the Gray coded amount of chunks
+    uint16_t steps = 0;
+    for (uint16_t gray = move.steps; gray; gray >>= 1) {
+        steps ^= gray;
+    }
+
+    int done = steps * chunk;
+    int count = min(chunk, fat[e].size - done);
+    if (count > 0) {
+        for (int i = 0; i < count; i++) {
+            updateDataByte(move.to + done + i, EEPROM.read(move.from + done + i));
+        }
+        countWrite();
+        steps++;
+        move.steps = steps ^ (steps >> 1);
+        updateBlock(moveAddress() + offsetof(Move, steps), &move.steps, sizeof(move.steps));
+    }
+
+    if (done + count >= fat[e].size) 
+        finishMove(e);
+}
+
+/**
+ * Start moving all file data together, directly behind the FAT. The data is moved in the background.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void defrag(CommandArgs argv)
+{
+    if (defragging) {
+        Serial.println(F("Error: defragmentation is already running."));
+        return;
+    }
+    defragging = true;
+    Serial.println(F("Defragmentation started."));
+}
+
+/**
+ * Check if file data is being moved by defrag.
+ * 
+ * @param addr begin address of the file data.
+ * @return true when the data is being moved.
+ */
+bool checkMoving(int addr)
+{
+    return move.from >= 0 && move.from == addr;
 }
 
 // Reset all values on EEPROM back to original. Debug use only.
 void debugResetEEPROM() 
 {
     for (uint16_t i = 0; i < EEPROM.length(); i++) {
-        EEPROM.write(i, 0xFF);
+        updateByte(i, 0xFF);
     }
+    memset(wear_counters, 0, sizeof(wear_counters));
+    unsaved_writes = 0;
 }
 
 // Print all bytes on the EEPROM. Debug use only.
@@ -0,0 +1,406 @@
+/*
+ *
+ * ArduinOS - GPIO source file
+ * src/gpio.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "gpio.h"
+
+static PinWait waits[MAX_PIN_WAITS];
+// amount of waits for pins without a pin change interrupt
+static uint8_t polled_waits = 0;
+// set when the wait of a pin with a pin change interrupt is over
+static volatile bool any_woken = false;
+
+#ifndef __AVR__
+// Simulated pin bank for builds without a board: 8 pins per port, with the input, direction and
+// output register of every port in RAM. An output pin reads back the level it drives.
+static volatile uint8_t pin_bank[(NUM_DIGITAL_PINS + 7) / 8][3];
+
+static void syncInputs(volatile uint8_t *regs)
+{
+    regs[PIN_REG] = (regs[PIN_REG] & ~regs[DDR_REG]) | (regs[PORT_REG] & regs[DDR_REG]);
+}
+#endif
+
+// Look up the port registers and the bit of a pin. Returns false for pins that don't exist.
+static bool resolvePin(int pin, PinCache *entry)
+{
+    if (pin < 0 || pin >= NUM_DIGITAL_PINS)
+        return false;
+#ifdef __AVR__
+    uint8_t port = digitalPinToPort(pin);
+    if (port == NOT_A_PIN)
+        return false;
+    entry->regs = portInputRegister(port);
+    entry->mask = digitalPinToBitMask(pin);
+#else
+    entry->regs = pin_bank[pin / 8];
+    entry->mask = 1 << (pin % 8);
+#endif
+    entry->pin = pin;
+    return true;
+}
+
+/**
+ * Find the port registers of a pin in the cache of a process. On the first use the registers are looked
+ * up and cached, replacing the oldest entry, and the core switches off PWM on the pin.
+ * 
+ * @param cache the pin cache of a process.
+ * @param pin the pin number.
+ * @return the cache entry of the pin, or NULL when the pin doesn't exist.
+ */
+static PinCache *lookupPin(PinCache *cache, int pin)
+{
+    for (uint8_t i = 0; i < PIN_CACHE_SIZE; i++) {
+        if (cache[i].regs != NULL && cache[i].pin == pin) {
+            return &cache[i];
+        }
+    }
+
+    PinCache entry;
+    if (!resolvePin(pin, &entry))
+        return NULL;
+    // the direct register accesses don't check for PWM, like digitalWrite and digitalRead do
+    digitalRead(pin);
+    memmove(cache + 1, cache, (PIN_CACHE_SIZE - 1) * sizeof(PinCache));
+    cache[0] = entry;
+    return &cache[0];
+}
+
+/**
+ * Set the mode of a pin.
+ * 
+ * @param cache the pin cache of the process.
+ * @param pin the pin number.
+ * @param mode INPUT, OUTPUT or INPUT_PULLUP.
+ * @return true when the mode is set, false for invalid pins or modes.
+ */
+bool gpioPinMode(PinCache *cache, int pin, int mode)
+{
+    PinCache *entry = lookupPin(cache, pin);
+    if (entry == NULL || (mode != INPUT && mode != OUTPUT && mode != INPUT_PULLUP))
+        return false;
+
+    volatile uint8_t *regs = entry->regs;
+    noInterrupts();
+    if (mode == OUTPUT) {
+        regs[DDR_REG] |= entry->mask;
+    }
+    else {
+        regs[DDR_REG] &= ~entry->mask;
+        if (mode == INPUT_PULLUP)
+            regs[PORT_REG] |= entry->mask;
+        else
+            regs[PORT_REG] &= ~entry->mask;
+    }
+#ifndef __AVR__
+    syncInputs(regs);
+#endif
+    interrupts();
+    return true;
+}
+
+/**
+ * Write the output register of a pin directly, instead of looking up the pin on every call like digitalWrite.
+ * 
+ * @param cache the pin cache of the process.
+ * @param pin the pin number.
+ * @param value LOW for 0, HIGH otherwise.
+ * @return true when the pin is written, false for invalid pins.
+ */
+bool gpioDigitalWrite(PinCache *cache, int pin, int value)
+{
+    PinCache *entry = lookupPin(cache, pin);
+    if (entry == NULL)
+        return false;
+
+    // the port can be changed by interrupts as well
+    volatile uint8_t *regs = entry->regs;
+    noInterrupts();
+    if (value == LOW)
+        regs[PORT_REG] &= ~entry->mask;
+    else
+        regs[PORT_REG] |= entry->mask;
+#ifndef __AVR__
+    syncInputs(regs);
+#endif
+    interrupts();
+    return true;
+}
+
+/**
+ * Read the input register of a pin directly.
+ * 
+ * @param cache the pin cache of the process.
+ * @param pin the pin number.
+ * @param value set to HIGH or LOW.
+ * @return true when the pin is read, false for invalid pins.
+ */
+bool gpioDigitalRead(PinCache *cache, int pin, uint8_t *value)
+{
+    PinCache *entry = lookupPin(cache, pin);
+    if (entry == NULL)
+        return false;
+    *value = (entry->regs[PIN_REG] & entry->mask) ? HIGH : LOW;
+    return true;
+}
+
+/**
+ * Write a PWM value to a pin. The pin should be removed from the pin cache of every process, so the next
+ * digital access switches PWM off again.
+ * 
+ * @param pin the pin number.
+ * @param value duty cycle from 0 to 255.
+ * @return true when the pin is written, false for invalid pins.
+ */
+bool gpioAnalogWrite(int pin, int value)
+{
+    if (pin < 0 || pin >= NUM_DIGITAL_PINS)
+        return false;
+    analogWrite(pin, value);
+    return true;
+}
+
+/**
+ * Read the value of an analog pin.
+ * 
+ * @param pin the analog pin, either the channel number or the pin number (A0 and up).
+ * @param value set to the value from 0 to 1023.
+ * @return true when the pin is read, false for invalid pins.
+ */
+bool gpioAnalogRead(int pin, int *value)
+{
+    if (pin < 0 || pin >= NUM_DIGITAL_PINS)
+        return false;
+    *value = analogRead(pin);
+    return true;
+}
+
+/**
+ * Remove a pin from the pin cache of a process.
+ * 
+ * @param cache the pin cache of the process.
+ * @param pin the pin number.
+ */
+void gpioForget(PinCache *cache, int pin)
+{
+    for (uint8_t i = 0; i < PIN_CACHE_SIZE; i++) {
+        if (cache[i].regs != NULL && cache[i].pin == pin) {
+            cache[i].regs = NULL;
+        }
+    }
+}
+
+// Check if the pin of a wait has the level the process waits for.
+static bool waitOver(const PinWait *wait)
+{
+    return (wait->regs[PIN_REG] & wait->mask) == wait->level;
+}
+
+#ifdef __AVR__
+// Wake the processes of which the pin got the level they wait for. Shared by the pin change interrupts of all ports.
+static void pinChanged()
+{
+    for (uint8_t i = 0; i < MAX_PIN_WAITS; i++) {
+        PinWait *wait = &waits[i];
+        if (wait->proc_id != 0 && wait->interrupt && !wait->woken && waitOver(wait)) {
+            wait->woken = true;
+            any_woken = true;
+        }
+    }
+}
+
+ISR(PCINT0_vect)
+{
+    pinChanged();
+}
+
+#ifdef PCINT1_vect
+ISR(PCINT1_vect)
+{
+    pinChanged();
+}
+#endif
+
+#ifdef PCINT2_vect
+ISR(PCINT2_vect)
+{
+    pinChanged();
+}
+#endif
+#endif
+
+// Enable the pin change interrupt of a pin. Returns false when the pin has none.
+static bool enableInterrupt(int pin)
+{
+#ifdef __AVR__
+    if (digitalPinToPCICR(pin) == NULL)
+        return false;
+    *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+    *digitalPinToPCICR(pin) |= bit(digitalPinToPCICRbit(pin));
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Remove a wait, the pin change interrupt is disabled when no other process waits for the pin.
+static void releaseWait(PinWait *wait)
+{
+    noInterrupts();
+    wait->proc_id = 0;
+    if (!wait->interrupt) {
+        polled_waits--;
+    }
+#ifdef __AVR__
+    // only pins of which the pin change interrupt was enabled have interrupt waits
+    else {
+        bool used = false;
+        for (uint8_t i = 0; i < MAX_PIN_WAITS; i++) {
+            if (waits[i].proc_id != 0 && waits[i].interrupt && waits[i].pin == wait->pin)
+                used = true;
+        }
+        if (!used)
+            *digitalPinToPCMSK(wait->pin) &= ~bit(digitalPinToPCMSKbit(wait->pin));
+    }
+#endif
+    interrupts();
+}
+
+/**
+ * Let a process wait until a pin has a level. Pins with a pin change interrupt are checked when they
+ * change, other pins are polled by gpioWoken().
+ * 
+ * @param cache the pin cache of the process.
+ * @param proc_id the process id of the process.
+ * @param pin the pin number.
+ * @param level LOW for 0, HIGH otherwise.
+ * @return 1 when the process has to wait, 0 when the pin already has the level, -1 for invalid pins
+ * or when too many processes wait.
+ */
+int gpioWaitPin(PinCache *cache, int proc_id, int pin, int level)
+{
+    PinCache *entry = lookupPin(cache, pin);
+    if (entry == NULL)
+        return -1;
+
+    PinWait *wait = NULL;
+    for (uint8_t i = 0; i < MAX_PIN_WAITS && wait == NULL; i++) {
+        if (waits[i].proc_id == 0)
+            wait = &waits[i];
+    }
+    if (wait == NULL) {
+        Serial.println(F("Error: too many processes wait for a pin."));
+        return -1;
+    }
+
+    wait->regs = entry->regs;
+    wait->mask = entry->mask;
+    wait->level = (level == LOW) ? 0 : entry->mask;
+    wait->pin = pin;
+    wait->woken = false;
+    // a change after this check raises the interrupt as soon as interrupts are enabled again
+    noInterrupts();
+    if (waitOver(wait)) {
+        interrupts();
+        return 0;
+    }
+    wait->interrupt = enableInterrupt(pin);
+    if (!wait->interrupt)
+        polled_waits++;
+    wait->proc_id = proc_id;
+    interrupts();
+    return 1;
+}
+
+/**
+ * Find a process of which the wait for a pin is over, and remove the wait. Returns immediately when
+ * no pin change interrupt fired and no pins are polled.
+ * 
+ * @return the process id of the process, or 0 when no wait is over.
+ */
+int gpioWoken()
+{
+    if (!any_woken && polled_waits == 0)
+        return 0;
+
+    any_woken = false;
+    for (uint8_t i = 0; i < MAX_PIN_WAITS; i++) {
+        PinWait *wait = &waits[i];
+        if (wait->proc_id != 0 && (wait->woken || (!wait->interrupt && waitOver(wait)))) {
+            int proc_id = wait->proc_id;
+            releaseWait(wait);
+            // other waits can be over as well
+            any_woken = true;
+            return proc_id;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check if a process waits for a pin.
+ * 
+ * @param proc_id the process id of the process.
+ * @return true when the process waits.
+ */
+bool gpioWaiting(int proc_id)
+{
+    for (uint8_t i = 0; i < MAX_PIN_WAITS; i++) {
+        if (waits[i].proc_id == proc_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Remove the wait of a process, when it has one.
+ * 
+ * @param proc_id the process id of the process.
+ */
+void gpioCancelWait(int proc_id)
+{
+    for (uint8_t i = 0; i < MAX_PIN_WAITS; i++) {
+        if (waits[i].proc_id == proc_id) {
+            releaseWait(&waits[i]);
+        }
+    }
+}
+
+#ifndef __AVR__
+// Set the level of an input pin of the simulated pin bank. Debug use only.
+void debugSetPin(int pin, uint8_t level)
+{
+    volatile uint8_t *regs = pin_bank[pin / 8];
+    uint8_t mask = 1 << (pin % 8);
+    if (!(regs[DDR_REG] & mask))
+        regs[PIN_REG] = level ? (regs[PIN_REG] | mask) : (regs[PIN_REG] & ~mask);
+}
+
+// Get the level of a pin of the simulated pin bank. Debug use only.
+uint8_t debugGetPin(int pin)
+{
+    return (pin_bank[pin / 8][PIN_REG] & (1 << (pin % 8))) ? HIGH : LOW;
+}
+#endif
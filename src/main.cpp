@@ -26,14 +26,19 @@
 #include "cli.h"
 #include "filesystem.h"
 #include "processes.h"
+#include "console.h"
+#include "autostart.h"
+#include "checkpoint.h"
 
 void setup() {
-  Serial.begin(9600);
+  beginConsole();
   Serial.setTimeout(-1);
 
-  Serial.println(F("ArduinOS 0.1 ready. Type \"help\" to see a list of commands."));
-
+  // programs in the autostart table are running before the prompt is printed
   initFileSystem();
+  bootProcesses();
+
+  Serial.println(F("ArduinOS 0.1 ready. Type \"help\" to see a list of commands."));
 }
 
 void loop() {
@@ -41,4 +46,10 @@ void loop() {
   argumentParser();
   // execute instruction for all processes
   runProcesses();
+  // write the output of the processes to the serial port
+  drainOutput();
+  // move a few bytes of file data when defragmenting
+  runDefrag();
+  // save the processes that are checkpointed periodically
+  runCheckpoints();
 }
\ No newline at end of file
@@ -93,13 +93,27 @@ static uint8_t checkMemoryTable(uint8_t size)
  * 
  * @param name name (1 byte) of the variable.
  * @param proc_id the process id of the process this variable belongs to. 
+ * @return true when the variable was saved, false otherwise.
  */
-void setVar(char name, int proc_id)
+bool setVar(char name, int proc_id)
+{
+    return setVarUntagged(name, popByte(proc_id), proc_id);
+}
+
+/**
+ * Pop a variable, of which the type is not on the stack, and save it in memory.
+ * 
+ * @param name name (1 byte) of the variable.
+ * @param type type of the variable.
+ * @param proc_id the process id of the process this variable belongs to. 
+ * @return true when the variable was saved, false otherwise.
+ */
+bool setVarUntagged(char name, uint8_t type, int proc_id)
 {
     // check if maximum reached
     if (no_of_vars == MAX_VAR_AMOUNT) {
         Serial.println(F("Error: max amount in variables in RAM reached."));
-        return;
+        return false;
     }
 
     // check if name and proc id exist
@@ -111,27 +125,29 @@ void setVar(char name, int proc_id)
     }
 
     // check for data on the stack
-    uint8_t type = popByte(proc_id);
     if (type == 0) {
         Serial.println(F("Error: cannot set variable, process not found."));
-        return;
+        return false;
     }
-    // check if type is a string
+    // check if type is a string, a reference to a string literal keeps referencing the program
     uint8_t size = type;
     if (type == STRING) {
         size = popByte(proc_id);
     }
+    else if (type == STRING_REF) {
+        size = STRING_REF_SIZE;
+    }
 
     // check for free space
     uint8_t addr = checkMemoryTable(size);
     if (addr == UINT8_MAX) 
-        return;
+        return false;
 
     // create new entry in memory table
     Variable var = {name, type, size, addr, proc_id};
 
-    // write bytes to memory
-    for (uint8_t a = addr; a < (addr + size); a++) {
+    // write bytes to memory, last byte on the stack is popped first
+    for (int a = addr + size - 1; a >= addr; a--) {
         memory[a] = popByte(proc_id);
     }
     variables[no_of_vars++] = var;
@@ -139,17 +155,12 @@ void setVar(char name, int proc_id)
     Serial.print(F("Sucessfully wrote variable "));
     Serial.print(name);
     Serial.println(F(" to memory."));
+    return true;
 }
 
-/**
- * Search for a variable in memory and push it on the stack.
- * 
- * @param name name (1 byte) of the variabele.
- * @param proc_id the process id of the process this variable belongs to.
- */
-void getVar(char name, int proc_id)
+// Push the data of a variable, and the size for strings. Returns the type, or 0 when not found.
+static uint8_t pushVar(char name, int proc_id)
 {
-    // check if var exists
     for (int e = 0; e < no_of_vars; e++) {
         if (name == variables[e].name && proc_id == variables[e].proc_id) {
             // push var data
@@ -159,15 +170,43 @@ void getVar(char name, int proc_id)
             // check if string, if so push size
             if (variables[e].type == STRING)
                 pushByte(variables[e].size, proc_id);
-            // push the var type
-            pushByte(variables[e].type, proc_id);
-            return;
+            return variables[e].type;
         }
     }
 
     Serial.print(F("Error: variable with name "));
     Serial.print(name);
     Serial.println(F(" not found in memory table."));
+    return 0;
+}
+
+/**
+ * Search for a variable in memory and push it on the stack.
+ * 
+ * @param name name (1 byte) of the variabele.
+ * @param proc_id the process id of the process this variable belongs to.
+ * @return true when the variable was found, false otherwise.
+ */
+bool getVar(char name, int proc_id)
+{
+    uint8_t type = pushVar(name, proc_id);
+    if (type == 0)
+        return false;
+    // push the var type
+    pushByte(type, proc_id);
+    return true;
+}
+
+/**
+ * Search for a variable in memory and push it on the stack, without the type.
+ * 
+ * @param name name (1 byte) of the variabele.
+ * @param proc_id the process id of the process this variable belongs to.
+ * @return true when the variable was found, false otherwise.
+ */
+bool getVarUntagged(char name, int proc_id)
+{
+    return pushVar(name, proc_id) != 0;
 }
 
 /**
@@ -201,6 +240,61 @@ void clearAllVars(int proc_id)
     }
 }
 
+/**
+ * Copy the variables of a process to a buffer, every variable as its name, type, size and data.
+ * 
+ * @param proc_id the process of which the variables are copied.
+ * @param out buffer for the variables, or NULL to only get the amount of bytes.
+ * @param count set to the amount of variables.
+ * @return amount of bytes.
+ */
+int packVars(int proc_id, uint8_t *out, uint8_t *count)
+{
+    int n = 0;
+    *count = 0;
+    for (int e = 0; e < no_of_vars; e++) {
+        if (proc_id != variables[e].proc_id) 
+            continue;
+        if (out != NULL) {
+            out[n] = variables[e].name;
+            out[n + 1] = variables[e].type;
+            out[n + 2] = variables[e].size;
+            memcpy(out + n + 3, memory + variables[e].addr, variables[e].size);
+        }
+        n += 3 + variables[e].size;
+        (*count)++;
+    }
+    return n;
+}
+
+/**
+ * Add the variables that were copied by packVars() to the memory table for a process.
+ * 
+ * @param proc_id the process the variables belong to.
+ * @param in the copied variables.
+ * @param count amount of variables.
+ * @return true when all variables were added, false otherwise.
+ */
+bool unpackVars(int proc_id, const uint8_t *in, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (no_of_vars == MAX_VAR_AMOUNT) {
+            Serial.println(F("Error: max amount in variables in RAM reached."));
+            return false;
+        }
+        uint8_t size = in[2];
+        uint8_t addr = checkMemoryTable(size);
+        if (addr == UINT8_MAX) 
+            return false;
+
+        Variable var = {(char)in[0], in[1], size, addr, proc_id};
+        memcpy(memory + addr, in + 3, size);
+        variables[no_of_vars++] = var;
+        in += 3 + size;
+    }
+    return true;
+}
+
 // Print the memory table entries. debug use only.
 void debugPrintMemoryTable() 
 {
@@ -0,0 +1,169 @@
+/*
+ *
+ * ArduinOS - Message queue source file
+ * src/message.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "message.h"
+
+static MessageQueue queues[MESSAGE_QUEUES];
+static MessageWait waits[MAX_MESSAGE_WAITS];
+// a message was sent or received since the waits were checked
+static bool changed = false;
+
+// Check if a waiting process can continue.
+static bool waitOver(MessageWait *wait)
+{
+    MessageQueue *q = &queues[wait->queue];
+    if (wait->needed == 0)
+        return q->length > 0;
+    return QUEUE_SIZE - q->length >= wait->needed;
+}
+
+/**
+ * Check if a message fits in a queue.
+ * 
+ * @param queue number of the queue.
+ * @param length size of the value, with its type.
+ * @return true when there is room for the message.
+ */
+bool messageFits(uint8_t queue, uint8_t length)
+{
+    return QUEUE_SIZE - queues[queue].length >= length + 1;
+}
+
+/**
+ * Add a message to a queue, the caller checks that it fits with messageFits().
+ * 
+ * @param queue number of the queue.
+ * @param data the value as it is on the stack, the type last.
+ * @param length size of the value.
+ */
+void messageSend(uint8_t queue, const uint8_t *data, uint8_t length)
+{
+    MessageQueue *q = &queues[queue];
+    uint8_t tail = (q->head + q->length) % QUEUE_SIZE;
+    q->buffer[tail] = length;
+    for (uint8_t i = 0; i < length; i++) {
+        q->buffer[(tail + 1 + i) % QUEUE_SIZE] = data[i];
+    }
+    q->length += length + 1;
+    changed = true;
+}
+
+/**
+ * Take the oldest message from a queue.
+ * 
+ * @param queue number of the queue.
+ * @param data buffer of MAX_MESSAGE_SIZE bytes for the value.
+ * @return size of the value, or 0 when the queue is empty.
+ */
+uint8_t messageReceive(uint8_t queue, uint8_t *data)
+{
+    MessageQueue *q = &queues[queue];
+    if (q->length == 0)
+        return 0;
+
+    uint8_t length = q->buffer[q->head];
+    for (uint8_t i = 0; i < length; i++) {
+        data[i] = q->buffer[(q->head + 1 + i) % QUEUE_SIZE];
+    }
+    q->head = (q->head + length + 1) % QUEUE_SIZE;
+    q->length -= length + 1;
+    changed = true;
+    return length;
+}
+
+/**
+ * Register a process that waits for a queue. The scheduler does not run the process until messageWoken()
+ * returns it.
+ * 
+ * @param queue number of the queue.
+ * @param proc_id the process id of the process.
+ * @param needed size of the message a sender waits to send, 0 for a receiver.
+ * @return true when the wait is registered, false when the wait table is full.
+ */
+bool messageWait(uint8_t queue, int proc_id, uint8_t needed)
+{
+    for (uint8_t i = 0; i < MAX_MESSAGE_WAITS; i++) {
+        if (waits[i].proc_id == 0) {
+            waits[i].proc_id = proc_id;
+            waits[i].queue = queue;
+            waits[i].needed = (needed > 0) ? needed + 1 : 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Get a process of which the wait is over, the wait is removed. Only checks the waits when a queue changed.
+ * 
+ * @return process id of the process, or 0 when no wait is over.
+ */
+int messageWoken()
+{
+    if (!changed)
+        return 0;
+
+    for (uint8_t i = 0; i < MAX_MESSAGE_WAITS; i++) {
+        MessageWait *wait = &waits[i];
+        if (wait->proc_id != 0 && waitOver(wait)) {
+            int proc_id = wait->proc_id;
+            wait->proc_id = 0;
+            // other waits can be over as well
+            return proc_id;
+        }
+    }
+    changed = false;
+    return 0;
+}
+
+/**
+ * Check if a process waits for a queue.
+ * 
+ * @param proc_id the process id of the process.
+ * @return true when the process waits.
+ */
+bool messageWaiting(int proc_id)
+{
+    for (uint8_t i = 0; i < MAX_MESSAGE_WAITS; i++) {
+        if (waits[i].proc_id == proc_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Remove the wait of a process, when it has one.
+ * 
+ * @param proc_id the process id of the process.
+ */
+void messageCancelWait(int proc_id)
+{
+    for (uint8_t i = 0; i < MAX_MESSAGE_WAITS; i++) {
+        if (waits[i].proc_id == proc_id) {
+            waits[i].proc_id = 0;
+        }
+    }
+}
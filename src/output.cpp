@@ -0,0 +1,95 @@
+/*
+ *
+ * ArduinOS - Output source file
+ * src/output.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "output.h"
+
+/**
+ * Write a byte to the output ring. Bytes that don't fit are dropped.
+ * 
+ * @param b the byte to write.
+ * @return 1 when the byte is written, 0 otherwise.
+ */
+size_t OutputPrint::write(uint8_t b)
+{
+    if (ring->buffer == NULL || ring->length == OUTPUT_SIZE)
+        return 0;
+    ring->buffer[(ring->head + ring->length++) % OUTPUT_SIZE] = b;
+    return 1;
+}
+
+/**
+ * Get the amount of bytes that can be written to an output ring.
+ * 
+ * @param ring the output ring of a process.
+ * @return amount of free bytes.
+ */
+uint8_t outputFree(OutputRing *ring)
+{
+    return OUTPUT_SIZE - ring->length;
+}
+
+/**
+ * Allocate the buffer of an output ring, when it has none yet.
+ * 
+ * @param ring the output ring of a process.
+ * @return true when the ring has a buffer, false when there is not enough RAM.
+ */
+bool outputAllocate(OutputRing *ring)
+{
+    if (ring->buffer == NULL) {
+        ring->buffer = (uint8_t*)malloc(OUTPUT_SIZE);
+        ring->head = 0;
+        ring->length = 0;
+    }
+    return ring->buffer != NULL;
+}
+
+/**
+ * Take the oldest byte from an output ring.
+ * 
+ * @param ring the output ring of a process.
+ * @return the byte, or -1 when the ring is empty.
+ */
+int outputRead(OutputRing *ring)
+{
+    if (ring->length == 0)
+        return -1;
+    uint8_t b = ring->buffer[ring->head];
+    ring->head = (ring->head + 1) % OUTPUT_SIZE;
+    ring->length--;
+    return b;
+}
+
+/**
+ * Free the buffer of an output ring, the output that is not written yet is lost.
+ * 
+ * @param ring the output ring of a process.
+ */
+void outputRelease(OutputRing *ring)
+{
+    free(ring->buffer);
+    ring->buffer = NULL;
+    ring->length = 0;
+}
@@ -26,12 +26,18 @@
 #include "common.h"
 #include "processes.h"
 #include "filesystem.h"
+#include "fileio.h"
 #include "memory.h"
+#include "message.h"
 #include "instruction_set.h"
 #include "stack.h"
+#include "trace.h"
+#include "verifier.h"
 
 static int no_of_processes = 0;
-static Process processes[AMOUNT_OF_FILES];
+static Process processes[MAX_PROCESSES];
+// index of the process of which the output is written to the serial port
+static int output_owner = 0;
 
 /**
  * Check if a process exists and if it is running.
@@ -49,6 +55,34 @@ int checkRunning(int proc_id)
     return -1;
 }
 
+/**
+ * Find the entry of a process in the process table.
+ * 
+ * @param proc_id the id of the process.
+ * @return the process, or NULL if it doesn't exist, or is terminated.
+ */
+Process *findProcess(int proc_id)
+{
+    int i = checkRunning(proc_id);
+    return (i < 0) ? NULL : &processes[i];
+}
+
+/**
+ * Check if a process executes a program from the EEPROM.
+ * 
+ * @param addr begin address of the program on the EEPROM.
+ * @return true when a process that is not terminated reads the program from the EEPROM.
+ */
+bool checkExecuting(int addr)
+{
+    for (int i = 0; i < no_of_processes; i++) {
+        if (processes[i].base == addr && processes[i].code == NULL && processes[i].state != terminated) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Change the status for a process.
  * 
@@ -64,10 +98,592 @@ void changeProcessStatus(int proc_id, State state)
                 Serial.print(proc_id);
                 Serial.print(F(". Process is already in this status."));
             }
-            else
+            else {
+                unsigned long now = millis();
+                // time spent outside the scheduler counts as waiting time
+                if (processes[i].state == paused || processes[i].state == blocked)
+                    processes[i].wait_time += now - processes[i].state_time;
                 processes[i].state = state;
+                processes[i].state_time = now;
+                // release the translated program and the open file
+                if (state == terminated && processes[i].code != NULL) {
+                    free(processes[i].code);
+                    processes[i].code = NULL;
+                }
+                if (state == terminated) {
+                    closeFile(proc_id);
+                    gpioCancelWait(proc_id);
+                    messageCancelWait(proc_id);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Toggle recording of executed instructions in the trace buffer for a process.
+ * 
+ * @param proc_id the id of the process.
+ * @return true when tracing is enabled after the toggle, false otherwise.
+ */
+bool toggleTrace(int proc_id)
+{
+    for (int i = 0; i < no_of_processes; i++) {
+        if (processes[i].id == proc_id) {
+            processes[i].trace = !processes[i].trace;
+            return processes[i].trace;
         }
     }
+    return false;
+}
+
+/**
+ * Terminate a process that can not continue, and dump the trace buffer for post-mortem debugging.
+ * 
+ * @param index index of the process in the process table.
+ * @param reason description of the fault.
+ */
+static void faultProcess(int index, const __FlashStringHelper *reason)
+{
+    // a fault can be raised multiple times during the same instruction
+    if (processes[index].state == terminated) return;
+
+    Serial.print(F("Error: process "));
+    Serial.print(processes[index].id);
+    Serial.print(F(" faulted at pc "));
+    Serial.print(processes[index].pc);
+    Serial.print(F(": "));
+    Serial.println(reason);
+    traceDump();
+
+    clearAllVars(processes[index].id);
+    changeProcessStatus(processes[index].id, terminated);
+}
+
+// Read a byte of the program of a process. Translated programs are read from RAM, all others from the EEPROM.
+static uint8_t programByte(Process *process, int addr)
+{
+    if (process->code != NULL)
+        return process->code[addr - process->base];
+    return readPcByte(addr);
+}
+
+/**
+ * Read the byte at the program counter of a process, and advance the program counter. A program
+ * that runs past its end, also a verified one that doesn't end with STOP, is terminated.
+ * 
+ * @param index index of the process in the process table.
+ * @return byte at the program counter, or 0 past the end of the program.
+ */
+static uint8_t fetchByte(int index)
+{
+    Process *process = &processes[index];
+    if (process->pc >= process->base + process->size) {
+        faultProcess(index, F("end of program reached"));
+        return 0;
+    }
+    return programByte(process, process->pc++);
+}
+
+/**
+ * Read a byte of the program of a process, for string literals that are referenced from the stack.
+ * 
+ * @param offset offset of the byte from the begin of the program.
+ * @param id process id of the process.
+ * @return byte at the offset, or 0 when the process doesn't exist.
+ */
+uint8_t readProgramByte(int offset, int id)
+{
+    for (int i = 0; i < no_of_processes; i++) {
+        if (processes[i].id == id)
+            return programByte(&processes[i], processes[i].base + offset);
+    }
+    return 0;
+}
+
+// Stop a process and clear its variables.
+static void instructionStop(int index, uint8_t instruction)
+{
+    clearAllVars(processes[index].id);
+    changeProcessStatus(processes[index].id, terminated);
+}
+
+// Push a char, int or float literal. The opcode equals the size of the value.
+static void instructionLiteral(int index, uint8_t instruction)
+{
+    for (uint8_t i = 0; i < instruction; i++) {
+        pushByte(fetchByte(index), processes[index].id);
+    }
+    pushByte(instruction, processes[index].id);
+}
+
+// Skip a null terminated string literal. Returns its offset in the program, so it stays valid when the program
+// is at another address after a restore. `size` is set to its size including the null char.
+static int skipString(int index, uint8_t *size)
+{
+    int addr = processes[index].pc;
+    while (fetchByte(index) != '\0');
+    *size = processes[index].pc - addr;
+    return addr - processes[index].base;
+}
+
+// Push a reference to a null terminated string literal, the chars stay in the program.
+static void instructionString(int index, uint8_t instruction)
+{
+    uint8_t size;
+    int offset = skipString(index, &size);
+    pushStringRef(offset, size, processes[index].id);
+}
+
+// Amount of bytes a value takes at most when printed. For strings `top` is the index of the length on the stack.
+static uint8_t printedLength(int index, uint8_t type, int top)
+{
+    switch (type) {
+        case CHAR: return 1;
+        case INT: return INT_DIGITS;
+        case FLOAT: return FLOAT_DIGITS;
+        case STRING:
+        case STRING_REF: return (top >= 0) ? processes[index].stack[top] - 1 : 0;
+    }
+    return 0;
+}
+
+/**
+ * Make sure a printed value fits in the output ring of a process. When it doesn't, the program counter
+ * is moved back to execute the instruction again once the value fits. The process waits for the serial
+ * port, without blocking the other processes.
+ * 
+ * @param index index of the process in the process table.
+ * @param instruction PRINT or PRINTLN.
+ * @param length the printed length of the value.
+ * @return true when the value fits.
+ */
+static bool reserveOutput(int index, uint8_t instruction, uint8_t length)
+{
+    Process *process = &processes[index];
+    if (instruction == PRINTLN)
+        length += 2;
+    if (!outputAllocate(&process->output)) {
+        faultProcess(index, F("not enough RAM for output"));
+        return false;
+    }
+    if (outputFree(&process->output) < length) {
+        process->pc--;
+        process->output_wait = length;
+        return false;
+    }
+    process->output_wait = 0;
+    return true;
+}
+
+/**
+ * Print a referenced string that doesn't fit in the output ring in parts. Every part fills the free space
+ * of the ring, then the reference on the stack is moved to the rest of the string and the instruction is
+ * executed again.
+ * 
+ * @param index index of the process in the process table.
+ * @param instruction PRINT or PRINTLN.
+ * @param top index of the size of the string on the stack.
+ * @return true when a part is printed, false when the string fits and is printed as usual.
+ */
+static bool printStringPart(int index, uint8_t instruction, int top)
+{
+    Process *process = &processes[index];
+    if (top < 2 || process->stack[top] - 1 + ((instruction == PRINTLN) ? 2 : 0) <= OUTPUT_SIZE)
+        return false;
+    if (!outputAllocate(&process->output)) {
+        faultProcess(index, F("not enough RAM for output"));
+        return true;
+    }
+
+    uint8_t part = outputFree(&process->output);
+    int offset = (process->stack[top - 2] << 8) | process->stack[top - 1];
+    OutputPrint out(&process->output);
+    for (uint8_t i = 0; i < part; i++) {
+        out.print((char)programByte(process, process->base + offset + i));
+    }
+    offset += part;
+    process->stack[top - 2] = (offset >> 8) & 0xFF;
+    process->stack[top - 1] = offset & 0xFF;
+    process->stack[top] -= part;
+    process->pc--;
+    process->output_wait = 1;
+    return true;
+}
+
+// Print the value on top of the stack.
+static void instructionPrint(int index, uint8_t instruction)
+{
+    Process *process = &processes[index];
+    uint8_t type = (process->sp > 0) ? process->stack[process->sp - 1] : 0;
+    if (type == STRING_REF && printStringPart(index, instruction, process->sp - 2))
+        return;
+    if (!reserveOutput(index, instruction, printedLength(index, type, process->sp - 2)))
+        return;
+    OutputPrint out(&process->output);
+    printVal(instruction, process->id, out);
+}
+
+// Pop the value on top of the stack into a variable.
+static void instructionSet(int index, uint8_t instruction)
+{
+    if (!setVar(fetchByte(index), processes[index].id))
+        faultProcess(index, F("cannot set variable"));
+}
+
+// Push the value of a variable.
+static void instructionGet(int index, uint8_t instruction)
+{
+    if (!getVar(fetchByte(index), processes[index].id))
+        faultProcess(index, F("cannot get variable"));
+}
+
+// Increment or decrement the value on top of the stack.
+static void instructionUnary(int index, uint8_t instruction)
+{
+    unaryOperation(instruction, processes[index].id);
+}
+
+// Open a file, the name and size are on the stack.
+static void instructionOpen(int index, uint8_t instruction)
+{
+    if (!openFile(processes[index].id))
+        faultProcess(index, F("cannot open file"));
+}
+
+// Close the open file.
+static void instructionClose(int index, uint8_t instruction)
+{
+    closeFile(processes[index].id);
+}
+
+// Write the value on top of the stack to the open file.
+static void instructionWrite(int index, uint8_t instruction)
+{
+    if (!writeFile(processes[index].id))
+        faultProcess(index, F("cannot write file"));
+}
+
+// Read a value of the type of the instruction from the open file.
+static void instructionRead(int index, uint8_t instruction)
+{
+    if (!readFile(instruction, processes[index].id))
+        faultProcess(index, F("cannot read file"));
+}
+
+// Pop a char, int or float from the stack as an int. Faults the process for other types.
+static bool popNumber(int index, int *value)
+{
+    uint8_t type = popByte(processes[index].id);
+    if (type != CHAR && type != INT && type != FLOAT) {
+        faultProcess(index, F("expected a number"));
+        return false;
+    }
+    *value = (int)popVal(type, processes[index].id);
+    return true;
+}
+
+// Set the mode of a pin, the pin and the mode are on the stack.
+static void instructionPinMode(int index, uint8_t instruction)
+{
+    int pin, mode;
+    if (!popNumber(index, &mode) || !popNumber(index, &pin))
+        return;
+    if (!gpioPinMode(processes[index].pins, pin, mode))
+        faultProcess(index, F("invalid pin or mode"));
+}
+
+// Write a pin, the pin and the value are on the stack.
+static void instructionDigitalWrite(int index, uint8_t instruction)
+{
+    int pin, value;
+    if (!popNumber(index, &value) || !popNumber(index, &pin))
+        return;
+    if (!gpioDigitalWrite(processes[index].pins, pin, value))
+        faultProcess(index, F("invalid pin"));
+}
+
+// Read the pin on the stack, and push its level as a char.
+static void instructionDigitalRead(int index, uint8_t instruction)
+{
+    int pin;
+    uint8_t value;
+    if (!popNumber(index, &pin))
+        return;
+    if (!gpioDigitalRead(processes[index].pins, pin, &value)) {
+        faultProcess(index, F("invalid pin"));
+        return;
+    }
+    pushChar(value, processes[index].id);
+}
+
+// Write a PWM value to a pin, the pin and the value are on the stack.
+static void instructionAnalogWrite(int index, uint8_t instruction)
+{
+    int pin, value;
+    if (!popNumber(index, &value) || !popNumber(index, &pin))
+        return;
+    if (!gpioAnalogWrite(pin, value)) {
+        faultProcess(index, F("invalid pin"));
+        return;
+    }
+    // the next digital access of any process switches PWM off
+    for (int i = 0; i < no_of_processes; i++) {
+        gpioForget(processes[i].pins, pin);
+    }
+}
+
+// Read the analog pin on the stack, and push its value as an int.
+static void instructionAnalogRead(int index, uint8_t instruction)
+{
+    int pin, value;
+    if (!popNumber(index, &pin))
+        return;
+    if (!gpioAnalogRead(pin, &value)) {
+        faultProcess(index, F("invalid pin"));
+        return;
+    }
+    pushInt(value, processes[index].id);
+}
+
+// Block the process until the pin on the stack has the level on the stack.
+static void instructionWaitPin(int index, uint8_t instruction)
+{
+    int pin, level;
+    if (!popNumber(index, &level) || !popNumber(index, &pin))
+        return;
+    int waiting = gpioWaitPin(processes[index].pins, processes[index].id, pin, level);
+    if (waiting < 0)
+        faultProcess(index, F("cannot wait for pin"));
+    else if (waiting > 0)
+        changeProcessStatus(processes[index].id, blocked);
+}
+
+/**
+ * Read the number of the queue on top of the stack without popping it, so a process that blocks
+ * executes the instruction again with the same stack.
+ * 
+ * @param index index of the process in the process table.
+ * @param queue set to the number of the queue.
+ * @param below set to the stack pointer below the number.
+ * @return true when the number is a valid queue, false when the process is terminated.
+ */
+static bool peekQueue(int index, uint8_t *queue, uint8_t *below)
+{
+    Process *process = &processes[index];
+    uint8_t type = (process->sp > 0) ? process->stack[process->sp - 1] : 0;
+    int value = -1;
+    if (type == CHAR && process->sp >= 2) {
+        value = process->stack[process->sp - 2];
+        *below = process->sp - 2;
+    }
+    else if (type == INT && process->sp >= 3) {
+        value = (int16_t)((process->stack[process->sp - 3] << 8) | process->stack[process->sp - 2]);
+        *below = process->sp - 3;
+    }
+    if (value < 0 || value >= MESSAGE_QUEUES) {
+        faultProcess(index, F("invalid queue"));
+        return false;
+    }
+    *queue = value;
+    return true;
+}
+
+// Block the process until it can send to or receive from a queue, the instruction is executed again afterwards.
+static void waitForQueue(int index, uint8_t queue, uint8_t needed)
+{
+    processes[index].pc--;
+    // without a free wait the process keeps trying every pass
+    if (messageWait(queue, processes[index].id, needed))
+        changeProcessStatus(processes[index].id, blocked);
+}
+
+// Send the value below the queue number on the stack to the queue, waiting while the queue is full.
+static void instructionSend(int index, uint8_t instruction)
+{
+    Process *process = &processes[index];
+    uint8_t queue, below;
+    if (!peekQueue(index, &queue, &below))
+        return;
+
+    // bytes of the value on the stack and in the message, a literal is sent as a string
+    uint8_t type = (below > 0) ? process->stack[below - 1] : 0;
+    uint8_t size = (below > 1) ? process->stack[below - 2] : 0;
+    int stacked = 0;
+    int length = 0;
+    switch (type) {
+        case CHAR:
+        case INT:
+        case FLOAT:
+            stacked = length = type + 1;
+            break;
+        case STRING:
+            stacked = length = size + 2;
+            break;
+        case STRING_REF:
+            stacked = STRING_REF_SIZE + 1;
+            length = size + 2;
+            break;
+    }
+    if (stacked == 0 || stacked > below) {
+        faultProcess(index, F("expected a value to send"));
+        return;
+    }
+    if (length > MAX_MESSAGE_SIZE) {
+        faultProcess(index, F("message longer than the queue"));
+        return;
+    }
+    if (!messageFits(queue, length)) {
+        waitForQueue(index, queue, length);
+        return;
+    }
+
+    uint8_t message[MAX_MESSAGE_SIZE];
+    process->sp = below - 1;
+    if (type == STRING_REF) {
+        int offset = popStringRef(&size, process->id);
+        for (uint8_t i = 0; i < size; i++) {
+            message[i] = programByte(process, process->base + offset + i);
+        }
+        message[size] = size;
+        message[size + 1] = STRING;
+    }
+    else {
+        message[length - 1] = type;
+        for (int i = length - 2; i >= 0; i--) {
+            message[i] = popByte(process->id);
+        }
+    }
+    messageSend(queue, message, length);
+}
+
+// Push the oldest value of the queue on the stack, waiting while the queue is empty.
+static void instructionReceive(int index, uint8_t instruction)
+{
+    uint8_t queue, below;
+    if (!peekQueue(index, &queue, &below))
+        return;
+
+    uint8_t message[MAX_MESSAGE_SIZE];
+    uint8_t length = messageReceive(queue, message);
+    if (length == 0) {
+        waitForQueue(index, queue, 0);
+        return;
+    }
+    processes[index].sp = below;
+    for (uint8_t i = 0; i < length; i++) {
+        pushByte(message[i], processes[index].id);
+    }
+}
+
+// Bytes that are not part of the instruction set terminate the process.
+static void instructionInvalid(int index, uint8_t instruction)
+{
+    processes[index].pc--;
+    faultProcess(index, F("invalid instruction"));
+}
+
+// Type of the operand of a typed instruction. Strings of translated programs are always references to literals.
+static uint8_t typedType(uint8_t instruction)
+{
+    return (TYPED_TYPE(instruction) == STRING) ? STRING_REF : TYPED_TYPE(instruction);
+}
+
+// Push a literal of a translated program, without the type.
+static void typedLiteral(int index, uint8_t instruction)
+{
+    uint8_t type = TYPED_TYPE(instruction);
+    if (type == STRING) {
+        uint8_t size;
+        int offset = skipString(index, &size);
+        pushByte((offset >> 8) & 0xFF, processes[index].id);
+        pushByte(offset & 0xFF, processes[index].id);
+        pushByte(size, processes[index].id);
+        return;
+    }
+    for (uint8_t i = 0; i < type; i++) {
+        pushByte(fetchByte(index), processes[index].id);
+    }
+}
+
+// Pop a value of a known type into a variable.
+static void typedSet(int index, uint8_t instruction)
+{
+    if (!setVarUntagged(fetchByte(index), typedType(instruction), processes[index].id))
+        faultProcess(index, F("cannot set variable"));
+}
+
+// Push the value of a variable, without the type.
+static void typedGet(int index, uint8_t instruction)
+{
+    if (!getVarUntagged(fetchByte(index), processes[index].id))
+        faultProcess(index, F("cannot get variable"));
+}
+
+// Print a value of a known type.
+static void typedPrint(int index, uint8_t instruction)
+{
+    Process *process = &processes[index];
+    uint8_t t = (TYPED_KIND(instruction) == TYPED_PRINT) ? PRINT : PRINTLN;
+    if (typedType(instruction) == STRING_REF && printStringPart(index, t, process->sp - 1))
+        return;
+    if (!reserveOutput(index, t, printedLength(index, typedType(instruction), process->sp - 1)))
+        return;
+    OutputPrint out(&process->output);
+    printUntagged(t, typedType(instruction), process->id, out);
+}
+
+// Increment or decrement a value of a known type.
+static void typedUnary(int index, uint8_t instruction)
+{
+    unaryUntagged((TYPED_KIND(instruction) == TYPED_INCREMENT) ? INCREMENT : DECREMENT, 
+        TYPED_TYPE(instruction), processes[index].id);
+}
+
+// Check if a byte is part of the instruction set.
+bool instructionValid(uint8_t instruction)
+{
+    return (instruction >= CHAR && instruction <= RECV) ||
+        (instruction >= IF && instruction <= WAITUNTILDONE);
+}
+
+// Check if an instruction is implemented by the executor.
+bool instructionSupported(uint8_t instruction)
+{
+    return (instruction >= CHAR && instruction <= DECREMENT) || 
+        (instruction >= PINMODE && instruction <= RECV) || instruction == STOP;
+}
+
+/**
+ * Execute an instruction of a translated program, of which the type of the operand is known.
+ * 
+ * @param index index of the process in the process table.
+ * @param instruction the typed instruction.
+ */
+static void executeTyped(int index, uint8_t instruction)
+{
+    switch (TYPED_KIND(instruction)) {
+        case TYPED_LITERAL:
+            typedLiteral(index, instruction);
+            break;
+        case TYPED_SET:
+            typedSet(index, instruction);
+            break;
+        case TYPED_GET:
+            typedGet(index, instruction);
+            break;
+        case TYPED_PRINT:
+        case TYPED_PRINTLN:
+            typedPrint(index, instruction);
+            break;
+        case TYPED_INCREMENT:
+        case TYPED_DECREMENT:
+            typedUnary(index, instruction);
+            break;
+        default:
+            instructionInvalid(index, instruction);
+            break;
+    }
 }
 
 /**
@@ -77,44 +693,84 @@ void changeProcessStatus(int proc_id, State state)
  */
 static void execute(int index)
 {
-    uint8_t instruction = readPcByte(processes[index].pc++);
-    uint8_t str_len = 0;
-    
-    switch(instruction) {
-        case STOP:
-            clearAllVars(processes[index].id);
-            changeProcessStatus(processes[index].id, terminated);
-            break;
+    uint8_t instruction = fetchByte(index);
+
+    if (processes[index].trace) {
+        traceRecord(processes[index].id, processes[index].pc - 1, 
+            instruction, processes[index].sp);
+    }
+
+    switch (instruction) {
         case CHAR:
         case INT:
         case FLOAT:
-            for (uint8_t i = 0; i < instruction; i++) {
-                pushByte(readPcByte(processes[index].pc++), processes[index].id);
-            }
-            pushByte(instruction, processes[index].id);
+            instructionLiteral(index, instruction);
             break;
         case STRING:
-            for (uint8_t b = readPcByte(processes[index].pc); b != '\0'; b = readPcByte(++processes[index].pc)) {
-                pushByte(readPcByte(processes[index].pc), processes[index].id);
-                str_len++;
-            }
-            pushByte('\0', processes[index].id);
-            pushByte(str_len + 1, processes[index].id);
-            pushByte(instruction, processes[index].id);
-            break;
-        case PRINT:
-        case PRINTLN:
-            printVal(instruction, processes[index].id);
+            instructionString(index, instruction);
             break;
         case SET:
-            setVar(readPcByte(processes[index].pc++), processes[index].id);
+            instructionSet(index, instruction);
             break;
         case GET:
-            getVar(readPcByte(processes[index].pc++), processes[index].id);
+            instructionGet(index, instruction);
             break;
         case INCREMENT:
         case DECREMENT:
-            unaryOperation(instruction, processes[index].id);
+            instructionUnary(index, instruction);
+            break;
+        case PINMODE:
+            instructionPinMode(index, instruction);
+            break;
+        case ANALOGREAD:
+            instructionAnalogRead(index, instruction);
+            break;
+        case ANALOGWRITE:
+            instructionAnalogWrite(index, instruction);
+            break;
+        case DIGITALREAD:
+            instructionDigitalRead(index, instruction);
+            break;
+        case DIGITALWRITE:
+            instructionDigitalWrite(index, instruction);
+            break;
+        case PRINT:
+        case PRINTLN:
+            instructionPrint(index, instruction);
+            break;
+        case OPEN:
+            instructionOpen(index, instruction);
+            break;
+        case CLOSE:
+            instructionClose(index, instruction);
+            break;
+        case WRITE:
+            instructionWrite(index, instruction);
+            break;
+        case READINT:
+        case READCHAR:
+        case READFLOAT:
+        case READSTRING:
+            instructionRead(index, instruction);
+            break;
+        case WAITPIN:
+            instructionWaitPin(index, instruction);
+            break;
+        case SEND:
+            instructionSend(index, instruction);
+            break;
+        case RECV:
+            instructionReceive(index, instruction);
+            break;
+        case STOP:
+            instructionStop(index, instruction);
+            break;
+        default:
+            if (instruction >= TYPED_BASE && instruction < TYPED_BASE + TYPED_AMOUNT)
+                executeTyped(index, instruction);
+            // valid instructions that are not implemented yet are skipped
+            else if (!instructionValid(instruction))
+                instructionInvalid(index, instruction);
             break;
     }
 }
@@ -122,34 +778,72 @@ static void execute(int index)
 // Run all processes that are in the 'running' state.
 void runProcesses()
 {
+    // processes of which the pin got the level they wait for
+    for (int proc_id = gpioWoken(); proc_id != 0; proc_id = gpioWoken()) {
+        int i = checkRunning(proc_id);
+        if (i >= 0 && processes[i].state == blocked)
+            changeProcessStatus(proc_id, running);
+    }
+    // processes that can send to or receive from the queue they wait for
+    for (int proc_id = messageWoken(); proc_id != 0; proc_id = messageWoken()) {
+        int i = checkRunning(proc_id);
+        if (i >= 0 && processes[i].state == blocked)
+            changeProcessStatus(proc_id, running);
+    }
+
     for (int i = 0; i < no_of_processes; i++) {
-        if (processes[i].state == running)
+        if (processes[i].state == running && outputFree(&processes[i].output) >= processes[i].output_wait) {
+            unsigned long start = micros();
             execute(i);
+            processes[i].run_time += micros() - start;
+            processes[i].instructions++;
+        }
     }
 }
 
 /**
- * Run a process by providing the process name.
- * 
- * @param argv CommandArgs struct with string arguments.
+ * Write the output of the processes to the serial port, only when it fits in the transmit buffer.
+ * The processes take turns per line, and a line is written at once, so lines of different processes
+ * and the messages of the commands are not mixed.
  */
-void run(CommandArgs argv) 
+void drainOutput()
 {
-    // parse filename argument
-    char *file_name;
-    if (strlen(argv.arg[0]) > 0) {
-        file_name = strdup(argv.arg[0]);
-    }
-    else {
-        Serial.println(F("Error: the filename argument is required."));
-        return;
+    int room = Serial.availableForWrite();
+    for (int n = 0; n < no_of_processes; n++) {
+        OutputRing *output = &processes[output_owner].output;
+        // the next line, or all output when there is no complete line
+        uint8_t length = 0;
+        while (length < output->length) {
+            if (output->buffer[(output->head + length++) % OUTPUT_SIZE] == '\n')
+                break;
+        }
+        if (length > room)
+            return;
+
+        room -= length;
+        for (uint8_t i = 0; i < length; i++) {
+            Serial.write(outputRead(output));
+        }
+        if (output->length == 0 && processes[output_owner].state == terminated)
+            outputRelease(output);
+        output_owner = (output_owner + 1) % no_of_processes;
     }
+}
 
+/**
+ * Start a process for a program. When `typed` is true, the program is translated to typed instructions
+ * and executed from RAM.
+ * 
+ * @param file_name name of the program.
+ * @param typed translate the program to typed instructions.
+ * @return id of the new process, or -1 when the program can not be started.
+ */
+int startProcess(const char *file_name, bool typed)
+{
     // check if there's space in process table
-    if (no_of_processes == AMOUNT_OF_FILES) {
+    if (no_of_processes == MAX_PROCESSES) {
         Serial.println(F("Error: no space left in process table."));
-        free(file_name);
-        return;
+        return -1;
     }
 
     // check if file exists in FAT
@@ -158,56 +852,183 @@ void run(CommandArgs argv)
         Serial.print(F("Error: file \""));
         Serial.print(file_name);
         Serial.println(F("\" not found in filesystem."));
-        free(file_name);
-        return;
+        return -1;
     }
     File file = readFATEntry(fat_entry_addr);
+    if (checkMoving(file.addr)) {
+        Serial.print(F("Error: file \""));
+        Serial.print(file_name);
+        Serial.println(F("\" is being moved by defrag."));
+        return -1;
+    }
+
+    // compressed programs are executed from a decompressed copy in RAM
+    int size = dataSize(file);
+    uint8_t *program = NULL;
+    if (isCompressed(file)) {
+        program = (uint8_t*)malloc(size);
+        if (program == NULL) {
+            Serial.println(F("Error: not enough RAM to decompress the program."));
+            return -1;
+        }
+        readFileData(file, program);
+    }
+
+    // translate the program when requested, this needs a copy of the program in RAM
+    uint8_t *code = NULL;
+    if (typed) {
+        code = (uint8_t*)malloc(size);
+        if (code == NULL)
+            Serial.println(F("Error: not enough RAM to translate the program."));
+    }
+
+    // check the program before it is executed
+    Verification verification = verifyProgram(file.addr, size, program, code);
+    if (!verification.valid) {
+        Serial.print(F("Error: program \""));
+        Serial.print(file_name);
+        Serial.println(F("\" can not be executed."));
+        free(program);
+        free(code);
+        return -1;
+    }
+    bool translated = code != NULL && verification.typed;
+    if (translated) {
+        free(program);
+    }
+    else {
+        if (code != NULL) {
+            if (program != NULL)
+                Serial.println(F("Program can not be translated, executing the decompressed program."));
+            else
+                Serial.println(F("Program can not be translated, executing it from the EEPROM."));
+            free(code);
+        }
+        code = program;
+    }
 
     // create entry in process table
     Process process = {0};
     strcpy(process.name, file.name);
     process.id = no_of_processes + 1;  // start id at 1 to allow for fail checks
     process.pc = file.addr;
+    process.base = file.addr;
+    process.size = size;
+    process.code = code;
     process.sp = 0;
     process.state = running;
+    process.verified = verification.bounded;
+    process.typed = translated;
+    process.start_time = millis();
+    process.state_time = process.start_time;
     processes[no_of_processes++] = process;
+    return process.id;
+}
+
+/**
+ * Run a process by providing the process name. When "typed" is provided as second argument,
+ * the program is translated to typed instructions and executed from RAM.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void run(CommandArgs argv) 
+{
+    // parse filename argument
+    if (strlen(argv.arg[0]) == 0) {
+        Serial.println(F("Error: the filename argument is required."));
+        return;
+    }
+
+    if (startProcess(argv.arg[0], strcmp(argv.arg[1], "typed") == 0) < 0)
+        return;
 
     Serial.print(F("Process "));
-    Serial.print(file_name);
+    Serial.print(argv.arg[0]);
     Serial.println(F(" is running."));
+}
 
-    free(file_name);    
+// Print an unsigned value right aligned in a column of `width` characters.
+static void printColumn(unsigned long v, uint8_t width)
+{
+    uint8_t digits = 1;
+    for (unsigned long d = v; d >= 10; d /= 10) {
+        digits++;
+    }
+    for (uint8_t i = digits; i < width; i++) {
+        Serial.print(' ');
+    }
+    Serial.print(v);
 }
 
 /**
- * List all running processes.
+ * Calculate the share of the elapsed time a process spent executing.
+ * 
+ * @param index index of the process in the process table.
+ * @return cpu usage in percent.
+ */
+static unsigned long cpuUsage(int index)
+{
+    unsigned long elapsed = millis() - processes[index].start_time;
+    if (elapsed == 0) return 0;
+    // run time is in microseconds, elapsed time in milliseconds
+    return processes[index].run_time / 10 / elapsed;
+}
+
+/**
+ * List all running processes, with the resources they used so far.
+ * When "cpu" is provided as argument, the list is sorted on cpu usage.
  * 
  * @param argv CommandArgs struct with string arguments.
  */
 void list(CommandArgs argv) 
 {
-    if (no_of_processes == 0) {
-        Serial.println(F("No running processes."));
-        return;
-    }
-
+    int order[MAX_PROCESSES];
     int processes_running = 0;
+
     for (int i = 0; i < no_of_processes; i++) {
         if (processes[i].state != terminated) {
-            Serial.print(processes[i].name);
-            Serial.print(F(", id: "));
-            Serial.print(processes[i].id);
-            Serial.print(F(", status: "));
-            Serial.println((char)processes[i].state);
-
-            processes_running++;
+            order[processes_running++] = i;
         }
     }
 
-    if (processes_running == 0) 
+    if (processes_running == 0) {
         Serial.println(F("No running processes."));
-}
+        return;
+    }
+
+    // sort on run time, most demanding process first
+    if (strcmp(argv.arg[0], "cpu") == 0) {
+        for (int c = 0; c < processes_running; c++) {
+            for (int n = c + 1; n < processes_running; n++) {
+                if (processes[order[c]].run_time < processes[order[n]].run_time) {
+                    int temp = order[c];
+                    order[c] = order[n];
+                    order[n] = temp;
+                }
+            }
+        }
+    }
 
+    Serial.println(F("  ID S       INSTR CPU%  RUN(ms) WAIT(ms)  SP NAME"));
+    for (int o = 0; o < processes_running; o++) {
+        int i = order[o];
+        unsigned long wait_time = processes[i].wait_time;
+        // include the time of the current wait
+        if (processes[i].state == paused || processes[i].state == blocked)
+            wait_time += millis() - processes[i].state_time;
+
+        printColumn(processes[i].id, 4);
+        Serial.print(' ');
+        Serial.print((char)processes[i].state);
+        printColumn(processes[i].instructions, 12);
+        printColumn(cpuUsage(i), 5);
+        printColumn(processes[i].run_time / 1000, 9);
+        printColumn(wait_time, 9);
+        printColumn(processes[i].sp_max, 4);
+        Serial.print(' ');
+        Serial.println(processes[i].name);
+    }
+}
 
 /**
  * Supend a process by providing the process id.
@@ -257,8 +1078,8 @@ void resume(CommandArgs argv)
         return;
     }
 
-    // Change the status for the process
-    changeProcessStatus(proc_id, running);
+    // Change the status for the process, a process that still waits for a pin or a queue stays blocked
+    changeProcessStatus(proc_id, (gpioWaiting(proc_id) || messageWaiting(proc_id)) ? blocked : running);
 }
 
 /**
@@ -299,7 +1120,13 @@ void pushByte(uint8_t b, int id)
 {
     for (int i = 0; i < no_of_processes; i++) {
         if (processes[i].id == id) {
+            if (!processes[i].verified && processes[i].sp == STACKSIZE) {
+                faultProcess(i, F("stack overflow"));
+                return;
+            }
             processes[i].stack[processes[i].sp++] = b;
+            if (processes[i].sp > processes[i].sp_max)
+                processes[i].sp_max = processes[i].sp;
         }
     }
 }
@@ -314,6 +1141,10 @@ uint8_t popByte(int id)
 {
     for (int i = 0; i < no_of_processes; i++) {
         if (processes[i].id == id) {
+            if (!processes[i].verified && processes[i].sp == 0) {
+                faultProcess(i, F("stack underflow"));
+                return 0;
+            }
             return processes[i].stack[--processes[i].sp];
         }
     }
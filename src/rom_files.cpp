@@ -0,0 +1,22 @@
+// Generated by: convert -rom blink hello
+
+#include <Arduino.h>
+#include "filesystem.h"
+
+const uint8_t rom_data[] PROGMEM = {
+    // blink
+    0x02, 0x00, 0x0d, 0x05, 0x70, 0x06, 0x70, 0x02, 0x00, 0x01, 0x2e, 0x85,
+    0x06, 0x70, 0x02, 0x00, 0x01, 0x32, 0x2d, 0x02, 0x01, 0xf4, 0x09, 0x2c,
+    0x06, 0x70, 0x02, 0x00, 0x00, 0x32, 0x2d, 0x02, 0x01, 0xf4, 0x09, 0x2c,
+    0x86,
+    // hello
+    0x03, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2c, 0x20, 0x77, 0x6f, 0x72, 0x6c,
+    0x64, 0x00, 0x34, 0x87,
+};
+
+const File rom_files[] PROGMEM = {
+    {"blink", ROM_DATA_PTR + 0, 37},
+    {"hello", ROM_DATA_PTR + 37, 16},
+};
+
+const uint8_t no_of_rom_files = 2;
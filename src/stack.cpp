@@ -27,6 +27,26 @@
 #include "instruction_set.h"
 #include "processes.h"
 
+// Push the 2 bytes of an int to the stack, without the type.
+static void pushIntBytes(int i, int id)
+{
+    uint16_t b;
+    memcpy(&b, &i, sizeof(b));
+    pushByte(((b >> 8) & 0xFF), id);
+    pushByte((b & 0xFF), id);
+}
+
+// Push the 4 bytes of a float to the stack, without the type.
+static void pushFloatBytes(float f, int id)
+{
+    uint32_t b;
+    memcpy(&b, &f, sizeof(f));
+    pushByte(((b >> 24) & 0xFF), id);
+    pushByte(((b >> 16) & 0xFF), id);
+    pushByte(((b >> 8) & 0xFF), id);
+    pushByte((b & 0xFF), id);
+}
+
 /**
  * Push a char to the stack.
  * 
@@ -45,10 +65,7 @@ void pushChar(char c, int id)
  */
 void pushInt(int i, int id) 
 {
-    uint16_t b;
-    memcpy(&b, &i, sizeof(i));
-    pushByte(((b >> 8) & 0xFF), id);
-    pushByte((b & 0xFF), id);
+    pushIntBytes(i, id);
     pushByte(INT, id);
 }
 
@@ -59,12 +76,7 @@ void pushInt(int i, int id)
  */
 void pushFloat(float f, int id)
 {
-    uint32_t b;
-    memcpy(&b, &f, sizeof(f));
-    pushByte(((b >> 24) & 0xFF), id);
-    pushByte(((b >> 16) & 0xFF), id);
-    pushByte(((b >> 8) & 0xFF), id);
-    pushByte((b & 0xFF), id);
+    pushFloatBytes(f, id);
     pushByte(FLOAT, id);
 }
 
@@ -83,6 +95,20 @@ void pushString(const char *s, int id)
     pushByte(STRING, id);
 }
 
+/**
+ * Push a reference to a string literal in the program of a process.
+ * 
+ * @param offset offset of the first char in the program.
+ * @param size size of the string, including the null char.
+ * @param id process id of the process.
+ */
+void pushStringRef(int offset, uint8_t size, int id)
+{
+    pushIntBytes(offset, id);
+    pushByte(size, id);
+    pushByte(STRING_REF, id);
+}
+
 /**
  * Pop an int from the stack.
  * 
@@ -154,38 +180,74 @@ void popString(char *s, int size, int id)
     }
 }
 
+/**
+ * Pop a reference to a string literal from the stack, without the type.
+ * 
+ * @param size pointer to save the size of the string into, including the null char.
+ * @param id process id of the process.
+ * @return offset of the first char in the program.
+ */
+int popStringRef(uint8_t *size, int id)
+{
+    *size = popByte(id);
+    uint8_t low = popByte(id);
+    return (popByte(id) << 8) | low;
+}
+
 /**
  * Print a value from the stack.
  * 
  * @param t instruction type.
  * @param id process id of the process.
- * @return value struct containing one char, int or float
+ * @param out where the value is printed.
  */
-void printVal(uint8_t t, int id)
+void printVal(uint8_t t, int id, Print &out)
+{
+    printUntagged(t, popByte(id), id, out);
+}
+
+/**
+ * Print a value from the stack, of which the type is not on the stack.
+ * 
+ * @param t instruction type.
+ * @param type type of the value.
+ * @param id process id of the process.
+ * @param out where the value is printed.
+ */
+void printUntagged(uint8_t t, uint8_t type, int id, Print &out)
 {
-    uint8_t type = popByte(id);
     float v = popVal(type, id);
     char *s;
 
     switch(type) {
         case CHAR:
-            if (t == PRINT) Serial.print((char)v);
-            else Serial.println((char)v);
+            if (t == PRINT) out.print((char)v);
+            else out.println((char)v);
             break;
         case INT:
-            if (t == PRINT) Serial.print((int)v);
-            else Serial.println((int)v);
+            if (t == PRINT) out.print((int)v);
+            else out.println((int)v);
             break;
         case FLOAT:
-            if (t == PRINT) Serial.print(v);
-            else Serial.println(v);
+            if (t == PRINT) out.print(v);
+            else out.println(v);
             break;
+        case STRING_REF: {
+            // the chars are printed straight from the program
+            uint8_t size;
+            int offset = popStringRef(&size, id);
+            for (uint8_t i = 0; i + 1 < size; i++) {
+                out.print((char)readProgramByte(offset + i, id));
+            }
+            if (t == PRINTLN) out.println();
+            break;
+        }
         case STRING:
             int size = popByte(id);
             s = (char*)malloc(size);
             popString(s, size, id);
-            if (t == PRINT) Serial.print(s);
-            else Serial.println(s);
+            if (t == PRINT) out.print(s);
+            else out.println(s);
             free(s);
             break;
     }
@@ -193,6 +255,7 @@ void printVal(uint8_t t, int id)
 
 /**
  * Pop a value from the stack, do a unary operation and push back the value.
+ * A string is left on the stack as it is, the result of a number is always pushed.
  * 
  * @param t instruction type.
  * @param id process id of the process.
@@ -200,8 +263,11 @@ void printVal(uint8_t t, int id)
 void unaryOperation(uint8_t t, int id)
 {
     uint8_t type = popByte(id);
+    if (type != CHAR && type != INT && type != FLOAT) {
+        pushByte(type, id);
+        return;
+    }
     float v = popVal(type, id);
-    if (v < 0) return;  // string
 
     switch(t) {
         case INCREMENT:
@@ -231,4 +297,31 @@ void unaryOperation(uint8_t t, int id)
             }
             break;
     }
+}
+
+/**
+ * Increment or decrement a char, int or float value, of which the type is not on the stack.
+ * The result is pushed back without the type.
+ * 
+ * @param t instruction type.
+ * @param type type of the value.
+ * @param id process id of the process.
+ */
+void unaryUntagged(uint8_t t, uint8_t type, int id)
+{
+    float v = popVal(type, id);
+    if (t == INCREMENT) v++;
+    else v--;
+
+    switch(type) {
+        case CHAR:
+            pushByte((char)v, id);
+            break;
+        case INT:
+            pushIntBytes((int)v, id);
+            break;
+        case FLOAT:
+            pushFloatBytes(v, id);
+            break;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+/*
+ *
+ * ArduinOS - Trace source file
+ * src/trace.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "common.h"
+#include "trace.h"
+#include "processes.h"
+
+static TraceRecord trace_buffer[TRACE_SIZE];
+static uint8_t trace_head = 0;
+static uint8_t trace_count = 0;
+
+/**
+ * Save an executed instruction in the trace ring buffer, overwriting the oldest record when full.
+ * Nothing is printed here, so tracing does not change the timing of a process.
+ * 
+ * @param pid process id of the process.
+ * @param pc program counter of the instruction.
+ * @param opcode the instruction that is executed.
+ * @param sp stack pointer before the instruction is executed.
+ */
+void traceRecord(uint8_t pid, int pc, uint8_t opcode, uint8_t sp)
+{
+    TraceRecord *record = &trace_buffer[trace_head];
+    record->pid = pid;
+    record->pc = pc;
+    record->opcode = opcode;
+    record->sp = sp;
+    record->micros = micros();
+
+    trace_head = (trace_head + 1) & (TRACE_SIZE - 1);
+    if (trace_count < TRACE_SIZE)
+        trace_count++;
+}
+
+// Print all records in the trace ring buffer, oldest record first.
+void traceDump()
+{
+    if (trace_count == 0) {
+        Serial.println(F("Trace buffer is empty."));
+        return;
+    }
+
+    uint8_t index = (trace_head - trace_count) & (TRACE_SIZE - 1);
+    for (uint8_t i = 0; i < trace_count; i++) {
+        TraceRecord *record = &trace_buffer[index];
+        Serial.print(record->micros);
+        Serial.print(F(": id: "));
+        Serial.print(record->pid);
+        Serial.print(F(", pc: "));
+        Serial.print(record->pc);
+        Serial.print(F(", op: "));
+        Serial.print(record->opcode);
+        Serial.print(F(", sp: "));
+        Serial.println(record->sp);
+
+        index = (index + 1) & (TRACE_SIZE - 1);
+    }
+}
+
+/**
+ * Dump the trace buffer, or toggle tracing for a process by providing the process id.
+ * 
+ * @param argv CommandArgs struct with string arguments.
+ */
+void trace(CommandArgs argv)
+{
+    if (strlen(argv.arg[0]) == 0) {
+        traceDump();
+        return;
+    }
+
+    int proc_id = atoi(argv.arg[0]);
+    if (proc_id <= 0) {
+        // value below 0, atoi failed
+        Serial.println(F("Error: invalid id provided."));
+        return;
+    }
+
+    // check if process exists and not terminated
+    int process = checkRunning(proc_id);
+    if (process < 0) {
+        Serial.print(F("Error: no process found with id "));
+        Serial.println(proc_id);
+        return;
+    }
+
+    Serial.print(F("Tracing "));
+    Serial.print(toggleTrace(proc_id) ? F("enabled") : F("disabled"));
+    Serial.print(F(" for process "));
+    Serial.println(proc_id);
+}
@@ -0,0 +1,586 @@
+/*
+ *
+ * ArduinOS - Verifier source file
+ * src/verifier.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <Arduino.h>
+#include "verifier.h"
+#include "filesystem.h"
+#include "instruction_set.h"
+#include "processes.h"
+#include "stack.h"
+
+typedef struct {
+    uint8_t type;
+    uint8_t size;       // bytes on the stack, including the type
+} StackValue;
+
+typedef struct {
+    uint8_t instruction;    // IF, ELSE, WHILE or LOOP
+    int target;             // address of the instruction that closes the block
+    uint8_t depth;          // values on the stack when the block started
+    uint8_t low;            // lowest amount of values on the stack within the block
+} Block;
+
+typedef struct {
+    char name;
+    uint8_t type;       // 0 when the type is not known at this point of the program
+    uint8_t size;
+    uint8_t level;      // block nesting level where the variable was first set
+} VarType;
+
+static StackValue stack[MAX_STACK_VALUES];
+static uint8_t depth;
+static uint8_t stack_bytes;
+static uint8_t max_stack;
+static Block blocks[MAX_BLOCK_DEPTH];
+static uint8_t no_of_blocks;
+static VarType vars[MAX_VERIFY_VARS];
+static uint8_t no_of_vars;
+static bool exact;      // the contents of the stack are known
+static bool underflow;
+static bool typed;      // all instructions so far could be translated
+static const uint8_t *source;   // program in RAM, or NULL when it is read from the EEPROM
+static int source_addr;
+
+// Read a byte of the program that is verified.
+static uint8_t readByte(int pc)
+{
+    if (source != NULL)
+        return source[pc - source_addr];
+    return readPcByte(pc);
+}
+
+// Stop tracking the stack, the stack usage of the program can't be determined.
+static void inexact()
+{
+    exact = false;
+}
+
+/**
+ * Print a diagnostic for a program that can't be executed.
+ * 
+ * @param pc address of the offending instruction.
+ * @param reason description of the problem.
+ * @return Verification struct of a rejected program.
+ */
+static Verification reject(int pc, const __FlashStringHelper *reason)
+{
+    Verification result = {false, false, 0, false};
+
+    Serial.print(F("Error: invalid program at pc "));
+    Serial.print(pc);
+    Serial.print(F(": "));
+    Serial.println(reason);
+    return result;
+}
+
+// Push a value with a known type on the abstract stack.
+static void push(uint8_t type, uint8_t size)
+{
+    if (!exact) return;
+
+    if (depth == MAX_STACK_VALUES || stack_bytes + size > UINT8_MAX) {
+        // this overflows the stack of a process for sure
+        inexact();
+        return;
+    }
+    stack[depth].type = type;
+    stack[depth].size = size;
+    depth++;
+    stack_bytes += size;
+    if (stack_bytes > max_stack)
+        max_stack = stack_bytes;
+}
+
+// Pop a value from the abstract stack. The type is 0 when it is not known.
+static StackValue pop()
+{
+    StackValue value = {0, 0};
+    if (!exact) return value;
+
+    if (depth == 0) {
+        underflow = true;
+        return value;
+    }
+    value = stack[--depth];
+    stack_bytes -= value.size;
+    if (no_of_blocks > 0 && depth < blocks[no_of_blocks - 1].low)
+        blocks[no_of_blocks - 1].low = depth;
+
+    return value;
+}
+
+// Type of the value on top of the abstract stack, 0 when not known.
+static uint8_t topType()
+{
+    if (!exact || depth == 0) return 0;
+    return stack[depth - 1].type;
+}
+
+// Push a value of a numeric type.
+static void pushType(uint8_t type)
+{
+    push(type, type + 1);
+}
+
+/**
+ * Pop a number of numeric values and push the result with the widest type of these values,
+ * following the order char, int, float.
+ * 
+ * @param amount the amount of values to pop.
+ */
+static void pushWidest(uint8_t amount)
+{
+    uint8_t type = CHAR;
+    for (uint8_t i = 0; i < amount; i++) {
+        StackValue value = pop();
+        if (value.type == 0 || value.type == STRING) {
+            inexact();
+            return;
+        }
+        if (value.type > type)
+            type = value.type;
+    }
+    pushType(type);
+}
+
+/**
+ * Pop a number of values and push a result with a fixed type.
+ * 
+ * @param amount the amount of values to pop.
+ * @param type the type of the result, 0 for no result.
+ */
+static void popPush(uint8_t amount, uint8_t type)
+{
+    for (uint8_t i = 0; i < amount; i++) {
+        pop();
+    }
+    if (type != 0) pushType(type);
+}
+
+// Save the type of a value that is popped into a variable.
+static void setVarType(char name, StackValue value)
+{
+    if (value.type == 0) {
+        inexact();
+        return;
+    }
+    for (uint8_t v = 0; v < no_of_vars; v++) {
+        if (vars[v].name == name) {
+            if (no_of_blocks == 0) {
+                // straight code, every following GET pushes the new value
+                vars[v].type = value.type;
+                vars[v].size = value.size;
+            }
+            else if (vars[v].type != value.type || vars[v].size < value.size) {
+                // within a block the type must be the same at every GET
+                inexact();
+            }
+            return;
+        }
+    }
+    if (no_of_vars == MAX_VERIFY_VARS) {
+        inexact();
+        return;
+    }
+    VarType var = {name, value.type, value.size, no_of_blocks};
+    vars[no_of_vars++] = var;
+}
+
+// Push the value of a variable.
+static void getVarType(char name)
+{
+    for (uint8_t v = 0; v < no_of_vars; v++) {
+        if (vars[v].name == name && vars[v].type != 0) {
+            push(vars[v].type, vars[v].size);
+            return;
+        }
+    }
+    inexact();
+}
+
+// Variables first set in a branch that is left, are not guaranteed to exist.
+static void forgetVars(uint8_t level)
+{
+    for (uint8_t v = 0; v < no_of_vars; v++) {
+        if (vars[v].level >= level)
+            vars[v].type = 0;
+    }
+}
+
+// Check if the stack is the same at the end of a block as at the start.
+static void checkBalanced(Block *block)
+{
+    if (depth != block->depth || block->low < block->depth)
+        inexact();
+}
+
+// Close the innermost block.
+static void closeBlock()
+{
+    Block *block = &blocks[--no_of_blocks];
+    if (block->instruction == LOOP) {
+        // the body of a loop always runs
+        for (uint8_t v = 0; v < no_of_vars; v++) {
+            if (vars[v].level > no_of_blocks)
+                vars[v].level = no_of_blocks;
+        }
+    }
+    else forgetVars(no_of_blocks + 1);
+
+    if (no_of_blocks > 0 && block->low < blocks[no_of_blocks - 1].low)
+        blocks[no_of_blocks - 1].low = block->low;
+}
+
+/**
+ * Replace an instruction of a translated program with its typed instruction.
+ * 
+ * @param code translated program, or NULL when the program is not translated.
+ * @param offset offset of the instruction in the program.
+ * @param kind kind of typed instruction.
+ * @param type type of the operand of the instruction, 0 when unknown.
+ */
+static void translate(uint8_t *code, int offset, uint8_t kind, uint8_t type)
+{
+    if (code == NULL) return;
+
+    if (type == 0 || !exact) typed = false;
+    else code[offset] = TYPED(kind, type);
+}
+
+// Amount of operand bytes after an instruction, strings excluded.
+static uint8_t operandSize(uint8_t instruction)
+{
+    switch (instruction) {
+        case CHAR:
+        case INT:
+        case FLOAT:
+            return instruction;
+        case SET:
+        case GET:
+        case IF:
+        case ELSE:
+            return 1;
+        case WHILE:
+            return 2;
+    }
+    return 0;
+}
+
+/**
+ * Verify a program before it is executed. The program is rejected when it contains invalid instructions,
+ * instructions that are cut off by the end of the file, jumps outside the file or unbalanced blocks.
+ * The stack usage is determined by following the types of all values on the stack.
+ * 
+ * When `code` is provided, the program is also translated to typed instructions. This only succeeds
+ * when the type of every value is known, and the program only uses instructions that have a typed form.
+ * 
+ * @param addr begin address of the program.
+ * @param size size of the program.
+ * @param program the program in RAM, or NULL to read it from the EEPROM at `addr`.
+ * @param code buffer of `size` bytes for the translated program, or NULL.
+ * @return Verification struct with the result.
+ */
+Verification verifyProgram(int addr, int size, const uint8_t *program, uint8_t *code)
+{
+    Verification result = {false, false, 0, false};
+    int end = addr + size;
+    int recent[RECENT_INSTRUCTIONS];
+    uint8_t recent_head = 0;
+    uint8_t last = 0;
+
+    depth = 0;
+    stack_bytes = 0;
+    max_stack = 0;
+    no_of_blocks = 0;
+    no_of_vars = 0;
+    exact = true;
+    underflow = false;
+    typed = true;
+    source = program;
+    source_addr = addr;
+    bool supported = true;
+
+    for (uint8_t i = 0; i < RECENT_INSTRUCTIONS; i++) {
+        recent[i] = -1;
+    }
+
+    for (int pc = addr; pc < end;) {
+        int start = pc;
+        uint8_t instruction = readByte(pc++);
+        last = instruction;
+
+        recent[recent_head] = start;
+        recent_head = (recent_head + 1) % RECENT_INSTRUCTIONS;
+
+        if (!instructionValid(instruction))
+            return reject(start, F("invalid instruction."));
+        if (!instructionSupported(instruction))
+            supported = false;
+
+        // operands
+        if (instruction == STRING) {
+            while (pc < end && readByte(pc) != '\0') {
+                pc++;
+            }
+            if (pc == end)
+                return reject(start, F("string without terminating null char."));
+            pc++;
+            // the size of a string, including the null char, is one byte on the stack
+            if (pc - start - 1 > UINT8_MAX)
+                return reject(start, F("string longer than 254 chars."));
+        }
+        else if (pc + operandSize(instruction) > end) {
+            return reject(start, F("instruction cut off by the end of the file."));
+        }
+        uint8_t operand = (operandSize(instruction) > 0) ? readByte(pc) : 0;
+        pc += operandSize(instruction);
+
+        if (code != NULL) {
+            for (int b = start; b < pc; b++) {
+                code[b - addr] = readByte(b);
+            }
+        }
+
+        Block *block = (no_of_blocks > 0) ? &blocks[no_of_blocks - 1] : NULL;
+        StackValue value;
+
+        switch (instruction) {
+            case CHAR:
+            case INT:
+            case FLOAT:
+                translate(code, start - addr, TYPED_LITERAL, instruction);
+                pushType(instruction);
+                break;
+            case STRING:
+                translate(code, start - addr, TYPED_LITERAL, STRING);
+                // reference to the chars in the program and type
+                push(STRING, STRING_REF_SIZE + 1);
+                break;
+            case SET:
+                value = pop();
+                translate(code, start - addr, TYPED_SET, value.type);
+                setVarType(operand, value);
+                break;
+            case GET:
+                getVarType(operand);
+                translate(code, start - addr, TYPED_GET, topType());
+                break;
+            case INCREMENT:
+            case DECREMENT:
+                translate(code, start - addr, (instruction == INCREMENT) ? TYPED_INCREMENT : TYPED_DECREMENT, 
+                    (topType() == STRING) ? 0 : topType());
+                pushWidest(1);
+                break;
+            case UNARYMINUS:
+            case ABS:
+            case SQ:
+            case BITWISENOT:
+                pushWidest(1);
+                break;
+            case LOGICALNOT:
+            case TOCHAR:
+            case DIGITALREAD:
+                popPush(1, CHAR);
+                break;
+            case TOINT:
+            case ROUND:
+            case FLOOR:
+            case CEIL:
+            case ANALOGREAD:
+                popPush(1, INT);
+                break;
+            case TOFLOAT:
+            case SQRT:
+                popPush(1, FLOAT);
+                break;
+            case PLUS:
+            case MINUS:
+            case TIMES:
+            case DIVIDEDBY:
+            case MODULUS:
+            case MIN:
+            case MAX:
+            case POW:
+            case BITWISEAND:
+            case BITWISEOR:
+            case BITWISEXOR:
+                pushWidest(2);
+                break;
+            case EQUALS:
+            case NOTEQUALS:
+            case LESSTHAN:
+            case LESSTHANOREQUALS:
+            case GREATERTHAN:
+            case GREATERTHANOREQUALS:
+            case LOGICALAND:
+            case LOGICALOR:
+            case LOGICALXOR:
+                popPush(2, CHAR);
+                break;
+            case CONSTRAIN:
+                pushWidest(3);
+                break;
+            case MAP:
+                pushWidest(5);
+                break;
+            case PRINT:
+            case PRINTLN:
+                value = pop();
+                translate(code, start - addr, (instruction == PRINT) ? TYPED_PRINT : TYPED_PRINTLN, value.type);
+                break;
+            case DELAY:
+            case DELAYUNTIL:
+            case WRITE:
+            case WAITUNTILDONE:
+                popPush(1, 0);
+                break;
+            case PINMODE:
+            case ANALOGWRITE:
+            case DIGITALWRITE:
+            case WAITPIN:
+            case SEND:
+            case OPEN:
+                popPush(2, 0);
+                break;
+            case MILLIS:
+            case READINT:
+                pushType(INT);
+                break;
+            case READCHAR:
+                pushType(CHAR);
+                break;
+            case READFLOAT:
+                pushType(FLOAT);
+                break;
+            case READSTRING:
+                // the length of the string is only known at runtime
+                inexact();
+                break;
+            case RECV:
+                // the type of the received value is only known at runtime
+                pop();
+                inexact();
+                break;
+            case FORK:
+                popPush(1, INT);
+                break;
+            case IF:
+                if (pc + operand >= end)
+                    return reject(start, F("jump outside the file."));
+                if (no_of_blocks == MAX_BLOCK_DEPTH)
+                    return reject(start, F("blocks nested too deep."));
+                // the condition stays on the stack
+                value = pop();
+                push(value.type, value.size);
+                blocks[no_of_blocks].instruction = IF;
+                blocks[no_of_blocks].target = pc + operand;
+                blocks[no_of_blocks].depth = depth;
+                blocks[no_of_blocks].low = depth;
+                no_of_blocks++;
+                break;
+            case ELSE:
+                if (block == NULL || block->instruction != IF || block->target != start)
+                    return reject(start, F("ELSE does not match an IF."));
+                if (pc + operand >= end)
+                    return reject(start, F("jump outside the file."));
+                checkBalanced(block);
+                forgetVars(no_of_blocks);
+                block->instruction = ELSE;
+                block->target = pc + operand;
+                block->low = depth;
+                break;
+            case ENDIF:
+                if (block == NULL || (block->instruction != IF && block->instruction != ELSE) || block->target != start)
+                    return reject(start, F("ENDIF does not match an IF."));
+                checkBalanced(block);
+                closeBlock();
+                pop();
+                break;
+            case WHILE: {
+                // the condition is evaluated right before the WHILE instruction
+                int condition = start - operand;
+                bool found = false;
+                for (uint8_t i = 0; i < RECENT_INSTRUCTIONS; i++) {
+                    if (recent[i] == condition && condition >= addr)
+                        found = true;
+                }
+                if (!found)
+                    return reject(start, F("jump to an invalid address."));
+                if (pc + readByte(pc - 1) >= end)
+                    return reject(start, F("jump outside the file."));
+                if (no_of_blocks == MAX_BLOCK_DEPTH)
+                    return reject(start, F("blocks nested too deep."));
+                pop();
+                blocks[no_of_blocks].instruction = WHILE;
+                blocks[no_of_blocks].target = pc + readByte(pc - 1);
+                blocks[no_of_blocks].depth = depth;
+                blocks[no_of_blocks].low = depth;
+                no_of_blocks++;
+                break;
+            }
+            case ENDWHILE:
+                if (block == NULL || block->instruction != WHILE || block->target != start)
+                    return reject(start, F("ENDWHILE does not match a WHILE."));
+                checkBalanced(block);
+                closeBlock();
+                break;
+            case LOOP:
+                if (no_of_blocks == MAX_BLOCK_DEPTH)
+                    return reject(start, F("blocks nested too deep."));
+                blocks[no_of_blocks].instruction = LOOP;
+                blocks[no_of_blocks].target = -1;
+                blocks[no_of_blocks].depth = depth;
+                blocks[no_of_blocks].low = depth;
+                no_of_blocks++;
+                break;
+            case ENDLOOP:
+                if (block == NULL || block->instruction != LOOP)
+                    return reject(start, F("ENDLOOP does not match a LOOP."));
+                checkBalanced(block);
+                closeBlock();
+                break;
+        }
+
+        if (underflow)
+            return reject(start, F("stack underflow."));
+
+        // only these instructions have a typed form, or don't use the stack at all
+        if (instruction != CHAR && instruction != INT && instruction != FLOAT && instruction != STRING &&
+            instruction != SET && instruction != GET && instruction != PRINT && instruction != PRINTLN &&
+            instruction != INCREMENT && instruction != DECREMENT && instruction != STOP)
+            typed = false;
+    }
+
+    if (no_of_blocks > 0)
+        return reject(end, F("block is not closed."));
+    // the last instruction may not fall through to the data of the next file
+    if (last != STOP && last != ENDLOOP)
+        return reject(end, F("program does not end with STOP or ENDLOOP."));
+
+    result.valid = true;
+    result.bounded = exact && supported && max_stack <= STACKSIZE;
+    result.max_stack = max_stack;
+    result.typed = code != NULL && typed && result.bounded;
+    return result;
+}
@@ -0,0 +1,90 @@
+/*
+ *
+ * ArduinOS - Arduino core for the native tests
+ * test/native/Arduino.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// The parts of the Arduino core that the modules under test use, the pins are simulated by the modules.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGH                1
+#define LOW                 0
+#define INPUT               0
+#define OUTPUT              1
+#define INPUT_PULLUP        2
+
+// pins and EEPROM of the Uno
+#define NUM_DIGITAL_PINS    20
+#define E2END               1023
+
+class __FlashStringHelper;
+#define F(string) (reinterpret_cast<const __FlashStringHelper*>(string))
+
+// program memory is ordinary memory on the host
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline int digitalRead(uint8_t pin) { return LOW; }
+inline void analogWrite(uint8_t pin, int value) {}
+inline int analogRead(uint8_t pin) { return 0; }
+
+// destination of printed output
+class Print {
+public:
+    virtual size_t write(uint8_t c) = 0;
+};
+
+// serial port that writes to stdout and never receives data
+class NativeSerial : public Print {
+public:
+    void print(const __FlashStringHelper *text) { fputs((const char*)text, stdout); }
+    void print(const char *text) { fputs(text, stdout); }
+    void print(char c) { putchar(c); }
+    void print(long value) { printf("%ld", value); }
+    void print(int value) { print((long)value); }
+    void print(unsigned long value) { printf("%lu", value); }
+    void print(unsigned int value) { print((unsigned long)value); }
+    void println() { putchar('\n'); }
+    template <typename T> void println(T value) { print(value); println(); }
+    size_t write(uint8_t c) { putchar(c); return 1; }
+    size_t write(const uint8_t *data, size_t size) { return fwrite(data, 1, size, stdout); }
+    int available() { return 0; }
+    size_t readBytes(char *buffer, size_t size) { return 0; }
+    size_t readBytes(uint8_t *buffer, size_t size) { return 0; }
+};
+
+extern NativeSerial Serial;
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ *
+ * ArduinOS - EEPROM library for the native tests
+ * test/native/EEPROM.h
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+// The EEPROM is kept in memory, it starts erased like a new board.
+#include <Arduino.h>
+
+class NativeEEPROM {
+public:
+    uint8_t data[E2END + 1];
+
+    uint8_t read(int addr) { return data[addr]; }
+    void write(int addr, uint8_t value) { data[addr] = value; }
+    void update(int addr, uint8_t value) { data[addr] = value; }
+    uint16_t length() { return E2END + 1; }
+    template <typename T> T &get(int addr, T &value) { memcpy(&value, &data[addr], sizeof(T)); return value; }
+    template <typename T> const T &put(int addr, const T &value) { memcpy(&data[addr], &value, sizeof(T)); return value; }
+};
+
+extern NativeEEPROM EEPROM;
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ *
+ * ArduinOS - filesystem tests
+ * test/test_filesystem/test_filesystem.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <unity.h>
+#include <EEPROM.h>
+#include "filesystem.h"
+
+void setUp()
+{
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    initFileSystem();
+}
+
+void tearDown() {}
+
+// Check the FAT entry of a file and read its data back.
+static void checkFile(const char *name, const uint8_t *data, int size, bool compressed)
+{
+    int f_addr = findFATEntry(name);
+    TEST_ASSERT_NOT_EQUAL(-1, f_addr);
+    File file = readFATEntry(f_addr);
+    TEST_ASSERT_EQUAL(compressed, isCompressed(file));
+    TEST_ASSERT_EQUAL(size, dataSize(file));
+
+    uint8_t stored[16];
+    readFileData(file, stored);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, stored, size);
+}
+
+// Data that starts with 0x00 is not taken for compressed data, also after a reset.
+void test_data_starting_with_zero()
+{
+    const uint8_t data[] = { 0x00, 0x05, 'h', 'e', 'l', 'l', 'o' };
+    TEST_ASSERT_NOT_EQUAL(-1, createFile("zero", sizeof(data), data, 0));
+    checkFile("zero", data, sizeof(data), false);
+
+    initFileSystem();
+    checkFile("zero", data, sizeof(data), false);
+}
+
+// A compressed file keeps its flag and is decompressed when it is read, also after a reset.
+void test_compressed_file()
+{
+    // original size 7, literals 'a' and 'b', then 5 bytes from 2 bytes back
+    const uint8_t data[] = { 0x00, 0x07, 0x04, 'a', 'b', 0x61 };
+    const uint8_t original[] = { 'a', 'b', 'a', 'b', 'a', 'b', 'a' };
+    TEST_ASSERT_NOT_EQUAL(-1, createFile("packed", sizeof(data), data, FILE_COMPRESSED));
+    checkFile("packed", original, sizeof(original), true);
+
+    initFileSystem();
+    checkFile("packed", original, sizeof(original), true);
+}
+
+// A filesystem of the first version is converted, its files keep their data.
+void test_old_format_converted()
+{
+    const uint8_t data[] = { 'h', 'e', 'l', 'l', 'o' };
+    memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+    EEPROM.data[0] = 1;
+    strcpy((char*)&EEPROM.data[OLD_FST_PTR], "old");
+    EEPROM.data[OLD_FST_PTR + FILENAME_SIZE] = 161;
+    EEPROM.data[OLD_FST_PTR + FILENAME_SIZE + 1] = 0;
+    EEPROM.data[OLD_FST_PTR + FILENAME_SIZE + 2] = sizeof(data);
+    EEPROM.data[OLD_FST_PTR + FILENAME_SIZE + 3] = 0;
+    memcpy(&EEPROM.data[161], data, sizeof(data));
+
+    initFileSystem();
+    TEST_ASSERT_EQUAL(FS_FORMAT, EEPROM.read(FORMAT_PTR));
+    checkFile("old", data, sizeof(data), false);
+}
+
+// A filesystem of an unknown format is not mounted and not written.
+void test_unknown_format_kept()
+{
+    const uint8_t data[] = { 'x' };
+    memset(EEPROM.data, 0x42, sizeof(EEPROM.data));
+    initFileSystem();
+    TEST_ASSERT_EQUAL(-1, createFile("new", sizeof(data), data, 0));
+    for (int addr = 0; addr < EEPROM.length(); addr++) {
+        TEST_ASSERT_EQUAL(0x42, EEPROM.read(addr));
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_data_starting_with_zero);
+    RUN_TEST(test_compressed_file);
+    RUN_TEST(test_old_format_converted);
+    RUN_TEST(test_unknown_format_kept);
+    return UNITY_END();
+}
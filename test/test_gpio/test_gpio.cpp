@@ -0,0 +1,98 @@
+/*
+ *
+ * ArduinOS - GPIO tests
+ * test/test_gpio/test_gpio.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <unity.h>
+#include "gpio.h"
+
+// pin cache of the process under test
+static PinCache cache[PIN_CACHE_SIZE];
+
+void setUp()
+{
+    memset(cache, 0, sizeof(cache));
+}
+
+void tearDown() {}
+
+// An output pin reads back the level it drives.
+void test_output_reads_back()
+{
+    uint8_t value;
+    TEST_ASSERT_TRUE(gpioPinMode(cache, 13, OUTPUT));
+    TEST_ASSERT_TRUE(gpioDigitalWrite(cache, 13, HIGH));
+    TEST_ASSERT_TRUE(gpioDigitalRead(cache, 13, &value));
+    TEST_ASSERT_EQUAL(HIGH, value);
+    TEST_ASSERT_TRUE(gpioDigitalWrite(cache, 13, LOW));
+    TEST_ASSERT_TRUE(gpioDigitalRead(cache, 13, &value));
+    TEST_ASSERT_EQUAL(LOW, value);
+}
+
+// The level of an input pin is set from outside, writing it only changes the pull-up.
+void test_input_reads_level()
+{
+    uint8_t value;
+    TEST_ASSERT_TRUE(gpioPinMode(cache, 2, INPUT));
+    debugSetPin(2, HIGH);
+    TEST_ASSERT_TRUE(gpioDigitalRead(cache, 2, &value));
+    TEST_ASSERT_EQUAL(HIGH, value);
+    gpioDigitalWrite(cache, 2, LOW);
+    TEST_ASSERT_EQUAL(HIGH, debugGetPin(2));
+    debugSetPin(2, LOW);
+    TEST_ASSERT_TRUE(gpioDigitalRead(cache, 2, &value));
+    TEST_ASSERT_EQUAL(LOW, value);
+}
+
+// Pins outside the pin bank and unknown modes are refused, the executor faults the process on these.
+void test_invalid_pins_refused()
+{
+    uint8_t value;
+    TEST_ASSERT_FALSE(gpioDigitalWrite(cache, NUM_DIGITAL_PINS, HIGH));
+    TEST_ASSERT_FALSE(gpioDigitalRead(cache, -1, &value));
+    TEST_ASSERT_FALSE(gpioPinMode(cache, 13, 7));
+    TEST_ASSERT_FALSE(gpioAnalogWrite(NUM_DIGITAL_PINS, 128));
+}
+
+// The oldest pin is replaced when the cache is full.
+void test_cache_replaces_oldest()
+{
+    for (int pin = 3; pin < 3 + PIN_CACHE_SIZE + 1; pin++) {
+        TEST_ASSERT_TRUE(gpioPinMode(cache, pin, OUTPUT));
+    }
+    TEST_ASSERT_EQUAL(3 + PIN_CACHE_SIZE, cache[0].pin);
+    for (uint8_t i = 0; i < PIN_CACHE_SIZE; i++) {
+        TEST_ASSERT_NOT_EQUAL(3, cache[i].pin);
+    }
+    gpioForget(cache, 3 + PIN_CACHE_SIZE);
+    TEST_ASSERT_NULL(cache[0].regs);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_output_reads_back);
+    RUN_TEST(test_input_reads_level);
+    RUN_TEST(test_invalid_pins_refused);
+    RUN_TEST(test_cache_replaces_oldest);
+    return UNITY_END();
+}
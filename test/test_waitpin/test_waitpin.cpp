@@ -0,0 +1,98 @@
+/*
+ *
+ * ArduinOS - WAITPIN tests
+ * test/test_waitpin/test_waitpin.cpp
+ *
+ * Copyright (C) 2021 Ricardo Steijn <0955903@hr.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ *
+ */
+
+#include <unity.h>
+#include "gpio.h"
+
+// pin cache of the process under test
+static PinCache cache[PIN_CACHE_SIZE];
+
+void setUp()
+{
+    memset(cache, 0, sizeof(cache));
+}
+
+void tearDown()
+{
+    gpioCancelWait(1);
+    gpioCancelWait(2);
+}
+
+// A wait for a pin outside the pin bank is refused, the executor faults the process on it.
+void test_wait_pin_invalid()
+{
+    TEST_ASSERT_EQUAL(-1, gpioWaitPin(cache, 1, NUM_DIGITAL_PINS, HIGH));
+    TEST_ASSERT_FALSE(gpioWaiting(1));
+}
+
+// A process that waits for a pin is woken when the pin gets the level, the pins of the bank are polled.
+void test_wait_pin_woken()
+{
+    TEST_ASSERT_TRUE(gpioPinMode(cache, 6, INPUT));
+    debugSetPin(6, LOW);
+    TEST_ASSERT_EQUAL(1, gpioWaitPin(cache, 1, 6, HIGH));
+    TEST_ASSERT_TRUE(gpioWaiting(1));
+    TEST_ASSERT_EQUAL(0, gpioWoken());
+
+    debugSetPin(6, HIGH);
+    TEST_ASSERT_EQUAL(1, gpioWoken());
+    TEST_ASSERT_FALSE(gpioWaiting(1));
+    TEST_ASSERT_EQUAL(0, gpioWoken());
+}
+
+// A pin that already has the level doesn't block the process.
+void test_wait_pin_level_reached()
+{
+    TEST_ASSERT_TRUE(gpioPinMode(cache, 7, INPUT));
+    debugSetPin(7, HIGH);
+    TEST_ASSERT_EQUAL(0, gpioWaitPin(cache, 1, 7, HIGH));
+    TEST_ASSERT_FALSE(gpioWaiting(1));
+}
+
+// Only MAX_PIN_WAITS processes wait at the same time, a cancelled wait frees its slot.
+void test_wait_pin_limit()
+{
+    TEST_ASSERT_TRUE(gpioPinMode(cache, 8, INPUT));
+    debugSetPin(8, LOW);
+    for (int id = 1; id <= MAX_PIN_WAITS; id++) {
+        TEST_ASSERT_EQUAL(1, gpioWaitPin(cache, id, 8, HIGH));
+    }
+    TEST_ASSERT_EQUAL(-1, gpioWaitPin(cache, MAX_PIN_WAITS + 1, 8, HIGH));
+
+    for (int id = 1; id <= MAX_PIN_WAITS; id++) {
+        gpioCancelWait(id);
+        TEST_ASSERT_FALSE(gpioWaiting(id));
+    }
+    TEST_ASSERT_EQUAL(0, gpioWoken());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_wait_pin_invalid);
+    RUN_TEST(test_wait_pin_woken);
+    RUN_TEST(test_wait_pin_level_reached);
+    RUN_TEST(test_wait_pin_limit);
+    return UNITY_END();
+}